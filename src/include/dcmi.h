@@ -72,7 +72,12 @@ void dcmi_restart_calibration_routine(void);
 void dma_swap_buffers(void);
 
 uint32_t get_time_between_images(void);
+float get_image_gradient(void);
+void dcmi_wait_image(const uint8_t *image, uint32_t size);
+void dcmi_update_exposure(void);
+uint32_t get_image_time(void);
 uint32_t get_frame_counter(void);
+uint32_t get_skipped_frame_counter(void);
 void reset_frame_counter(void);
 
 #endif /* DCMI_H_ */
@@ -36,10 +36,64 @@
 
 #include <stdint.h>
 
+/**
+ * @brief Similarity motion model of the tile vectors (BFLOW_MODEL)
+ */
+typedef struct
+{
+	float rotation;		///< rotation around the image center in rad per frame
+	float divergence;	///< relative scale change per frame, positive when approaching
+	uint8_t inliers;	///< number of tiles consistent with the model, 0 if not fitted
+} flow_model_t;
+
+/**
+ * @brief Match result of one tile (USB_SEND_FIELD)
+ *
+ * Sent as is over USB, 10 bytes little endian per tile.
+ */
+typedef struct
+{
+	uint8_t x;		///< upper left corner of the tile in image1
+	uint8_t y;
+	int8_t flow_x;		///< shift of the best match in 1/8 pixel, subpixel refined if accepted
+	int8_t flow_y;
+	uint16_t sad;		///< best SAD, FLOW_TILE_ACCEPTED set if the tile passed BFLOW_V_THLD
+	uint16_t sad2;		///< second best SAD two or more pixels away, of the coarse search with BFLOW_PYRAMID
+	uint16_t score;		///< texture score, saturated
+} flow_tile_t;
+
+#define FLOW_TILE_ACCEPTED	0x8000	///< flag in flow_tile_t.sad
+#define FLOW_TILE_NO_SAD	0x7FFF	///< SAD of tiles skipped for too little texture
+
 /**
  * @brief Computes pixel flow from image1 to image2
  */
 uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rate, float z_rate,
 		float *histflowx, float *histflowy);
 
+/**
+ * @brief Tiles the compute budget dropped in the last compute_flow call
+ */
+uint16_t get_flow_budget_dropped(void);
+
+/**
+ * @brief Gyro compensation of a flow measured over one frame
+ */
+void compensate_flow_gyro(float x_rate, float y_rate, float *pixel_flow_x, float *pixel_flow_y);
+
+/**
+ * @brief Drop the cached census transform of an image buffer
+ */
+void flow_invalidate_image(const uint8_t *image);
+
+/**
+ * @brief Motion model of the last compute_flow call
+ */
+const flow_model_t *get_flow_model(void);
+
+/**
+ * @brief Tile field of the last compute_flow call
+ */
+const flow_tile_t *get_flow_field(uint16_t *count);
+
 #endif /* FLOW_H_ */
@@ -34,11 +34,16 @@
 #ifndef __PX4_FLOWBOARD_H
 #define __PX4_FLOWBOARD_H
 
+extern uint32_t SystemCoreClock;
+
+#define CYCLES_PER_US	(SystemCoreClock / 1000000) // core clock in MHz
+
 extern uint32_t get_time_between_images(void);
 
 void timer_update(void);
 void timer_update_ms(void);
 uint32_t get_boot_time_ms(void);
-uint32_t get_boot_time_us(void);
+uint64_t get_boot_time_us(void);
+uint32_t get_cycle_count(void);
 
 #endif /* __PX4_FLOWBOARD_H */
@@ -45,6 +45,8 @@
 #define BINNING_ROW_B					2
 #define BINNING_COLUMN_B				2
 #define MINIMUM_HORIZONTAL_BLANKING		91 // see datasheet
+#define HORIZONTAL_BLANKING_A			(350 + MINIMUM_HORIZONTAL_BLANKING) // 350 is minimum value without distortions
+#define MASTER_CLOCK_MHZ				21 // TIM3 PWM of dcmi_clock_init, 84 MHz / 4
 #define MAX_IMAGE_HEIGHT				480
 #define MAX_IMAGE_WIDTH					752
 #define MINIMUM_COLUMN_START			1
@@ -112,6 +114,7 @@
 #define MTV_MAX_EXPOSURE_REG       		0xAD  // datasheet max coarse shutter width
 #define MTV_AEC_AGC_ENABLE_REG			0xAF
 #define MTV_AGC_AEC_PIXEL_COUNT_REG		0xB0
+#define MTV_AEC_EXPOSURE_REG			0xBB  // coarse shutter width chosen by the AEC, read only
 #define MTV_AEC_UPDATE_REG				0xA6
 #define MTV_AEC_LOWPASS_REG				0xA8
 #define MTV_AGC_UPDATE_REG				0xA9
@@ -141,6 +144,8 @@ void mt9v034_context_configuration(void);
 void mt9v034_set_context(void);
 
 uint16_t mt9v034_ReadReg16(uint8_t address);
+float mt9v034_get_row_time_us(void);
+uint16_t mt9v034_get_exposure_rows(void);
 uint8_t mt9v034_WriteReg16(uint16_t address, uint16_t Data);
 uint8_t mt9v034_ReadReg(uint16_t Addr);
 uint8_t mt9v034_WriteReg(uint16_t Addr, uint8_t Data);
@@ -68,6 +68,16 @@ typedef enum
   LEFT   = 0x05  	/*!< at left position */
 } SensorPosition_TypeDef;
 
+/**
+  * @brief  block matching cost enumeration
+  */
+typedef enum
+{
+  MATCHER_SAD    = 0x00, 	/*!< sum of absolute pixel differences */
+  MATCHER_CENSUS = 0x01, 	/*!< hamming distance of census transformed images */
+  MATCHER_ZSAD   = 0x02 	/*!< SAD of the pixel differences to the window means */
+} FlowMatcher_TypeDef;
+
 /**
   * @brief  sensor position enumeration
   */
@@ -129,6 +139,7 @@ enum global_param_id_t
 	PARAM_USB_SEND_GYRO,
 	PARAM_USB_SEND_FORWARD,
 	PARAM_USB_SEND_DEBUG,
+	PARAM_USB_SEND_FIELD,
 
 	PARAM_VIDEO_ONLY,
 	PARAM_VIDEO_RATE,
@@ -140,6 +151,21 @@ enum global_param_id_t
 	PARAM_BOTTOM_FLOW_LP_FILTERED,
 	PARAM_BOTTOM_FLOW_WEIGHT_NEW,
 	PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR,
+	PARAM_BOTTOM_FLOW_PYRAMID,
+	PARAM_BOTTOM_FLOW_GYRO_PREDICTION,
+	PARAM_BOTTOM_FLOW_EARLY_TERMINATION,
+	PARAM_BOTTOM_FLOW_TILE_SELECTION,
+	PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE,
+	PARAM_BOTTOM_FLOW_PARABOLIC,
+	PARAM_BOTTOM_FLOW_MODEL,
+	PARAM_BOTTOM_FLOW_MATCHER,
+	PARAM_BOTTOM_FLOW_KEYFRAME,
+	PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT,
+	PARAM_BOTTOM_FLOW_KEYFRAME_QUALITY,
+	PARAM_BOTTOM_FLOW_BUDGET,
+	PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD,
+	PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD,
+	PARAM_BOTTOM_FLOW_PIPELINE,
 
 	PARAM_SENSOR_POSITION,
 	DEBUG_VARIABLE,
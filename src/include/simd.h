@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2013 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Cortex-M4 SIMD intrinsics used by the flow engine.
+ *
+ * On the target the CMSIS implementations from core_cm4_simd.h are used.
+ * Everywhere else (HOST_TEST builds) the same instructions are provided
+ * as portable C, producing bit-identical results.
+ *
+ * x86 hosts with SSE2 additionally get SIMD_SSE2 kernels for the offline
+ * replay, define SIMD_PORTABLE_ONLY to build with the plain C versions.
+ */
+#if defined(__ARM_FEATURE_DSP)
+
+#define __INLINE inline
+#define __ASM asm
+#include "core_cm4_simd.h"
+
+#else
+
+/**
+ * @brief Bytewise modulo 256 addition (uadd8)
+ */
+static inline uint32_t __UADD8(uint32_t op1, uint32_t op2)
+{
+	uint32_t result = 0;
+
+	for (uint8_t k = 0; k < 32; k += 8)
+	{
+		result |= ((((op1 >> k) & 0xFF) + ((op2 >> k) & 0xFF)) & 0xFF) << k;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Bytewise saturating addition (uqadd8)
+ */
+static inline uint32_t __UQADD8(uint32_t op1, uint32_t op2)
+{
+	uint32_t result = 0;
+
+	for (uint8_t k = 0; k < 32; k += 8)
+	{
+		uint32_t sum = ((op1 >> k) & 0xFF) + ((op2 >> k) & 0xFF);
+		result |= (sum > 0xFF ? 0xFF : sum) << k;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Bytewise halving addition (uhadd8)
+ */
+static inline uint32_t __UHADD8(uint32_t op1, uint32_t op2)
+{
+	/* (a + b) / 2 per byte without carry into the neighbour byte */
+	return (op1 & op2) + (((op1 ^ op2) >> 1) & 0x7F7F7F7F);
+}
+
+/**
+ * @brief Bytewise halving subtraction (uhsub8)
+ *
+ * Bit 7 of every result byte is set if the byte of op1 is smaller.
+ */
+static inline uint32_t __UHSUB8(uint32_t op1, uint32_t op2)
+{
+	uint32_t result = 0;
+
+	for (uint8_t k = 0; k < 32; k += 8)
+	{
+		int32_t d = (int32_t)((op1 >> k) & 0xFF) - (int32_t)((op2 >> k) & 0xFF);
+		result |= ((uint32_t)(d >> 1) & 0xFF) << k;
+	}
+
+	return result;
+}
+
+/**
+ * @brief Sum of absolute differences of four bytes with accumulation (usada8)
+ */
+static inline uint32_t __USADA8(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+	int32_t d0 = (int32_t)((op1 >>  0) & 0xFF) - (int32_t)((op2 >>  0) & 0xFF);
+	int32_t d1 = (int32_t)((op1 >>  8) & 0xFF) - (int32_t)((op2 >>  8) & 0xFF);
+	int32_t d2 = (int32_t)((op1 >> 16) & 0xFF) - (int32_t)((op2 >> 16) & 0xFF);
+	int32_t d3 = (int32_t)((op1 >> 24) & 0xFF) - (int32_t)((op2 >> 24) & 0xFF);
+
+	return op3 + (uint32_t)(abs(d0) + abs(d1) + abs(d2) + abs(d3));
+}
+
+/**
+ * @brief Sum of absolute differences of four bytes (usad8)
+ */
+static inline uint32_t __USAD8(uint32_t op1, uint32_t op2)
+{
+	return __USADA8(op1, op2, 0);
+}
+
+#if defined(__SSE2__) && !defined(SIMD_PORTABLE_ONLY)
+
+#define SIMD_SSE2
+
+#include <emmintrin.h>
+
+/**
+ * @brief Load two consecutive 8 pixel rows into one register
+ */
+static inline __m128i simd_load_rows_8x2(const uint8_t *p, uint16_t row_size)
+{
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*) p), _mm_loadl_epi64((const __m128i*) (p + row_size)));
+}
+
+/**
+ * @brief Bytewise halving addition, equal to uhadd8
+ *
+ * pavgb rounds up, so the carry of odd sums is removed again.
+ */
+static inline __m128i simd_uhadd_epu8(__m128i a, __m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+/**
+ * @brief Add the two partial sums of a psadbw result
+ */
+static inline uint32_t simd_sad_sum(__m128i sad)
+{
+	return (uint32_t) _mm_cvtsi128_si32(sad) + (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+}
+
+/**
+ * @brief SAD of two 8x8 pixel windows, equal to 16 usada8
+ */
+static inline uint32_t simd_sad_8x8(const uint8_t *p1, const uint8_t *p2, uint16_t row_size)
+{
+	__m128i sad = _mm_setzero_si128();
+
+	for (uint8_t row = 0; row < 8; row += 2)
+	{
+		sad = _mm_add_epi64(sad, _mm_sad_epu8(simd_load_rows_8x2(p1 + row * row_size, row_size),
+				simd_load_rows_8x2(p2 + row * row_size, row_size)));
+	}
+
+	return simd_sad_sum(sad);
+}
+
+#endif /* __SSE2__ */
+
+#endif /* __ARM_FEATURE_DSP */
+
+#endif /* SIMD_H_ */
@@ -34,6 +34,7 @@ void SVC_Handler(void);
 void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
+void TIM5_IRQHandler(void);
 
 #endif /* __STM32F4xx_IT_H */
 
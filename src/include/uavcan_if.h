@@ -75,10 +75,18 @@ typedef struct range_data_t {
     float                      range;
 } range_data_t;
 
+typedef struct ttc_data_t {
+    uint64_t    time_stamp_utc;
+    float       time_to_contact;
+    float       divergence;
+    uint8_t     qual;
+} ttc_data_t;
+
 __BEGIN_DECLS
 __EXPORT int uavcannode_run(void);
 __EXPORT int uavcannode_publish_flow(legacy_12c_data_t *pdata);
 __EXPORT int uavcannode_publish_range(range_data_t *pdata);
+__EXPORT int uavcannode_publish_ttc(ttc_data_t *pdata);
 __EXPORT int uavcannode_main(bool start_not_stop);
 __END_DECLS
 
@@ -48,7 +48,7 @@
 #include "debug.h"
 #include "communication.h"
 
-extern uint32_t get_boot_time_us(void);
+extern uint64_t get_boot_time_us(void);
 extern void buffer_reset(void);
 extern void systemreset(bool to_bootloader);
 
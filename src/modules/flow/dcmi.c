@@ -42,6 +42,7 @@
 #include <mavlink.h>
 #include "utils.h"
 #include "dcmi.h"
+#include "flow.h"
 #include "stm32f4xx_gpio.h"
 #include "stm32f4xx_rcc.h"
 #include "stm32f4xx_i2c.h"
@@ -62,28 +63,105 @@ volatile uint32_t frame_counter;
 volatile uint32_t time_last_frame = 0;
 volatile uint32_t cycle_time = 0;
 volatile uint32_t time_between_next_images;
+uint32_t skipped_frame_counter = 0;
+float image_gradient = 0.0f;
 volatile uint8_t dcmi_calibration_counter = 0;
 
 /* state variables */
 volatile uint8_t dcmi_image_buffer_memory0 = 1;
 volatile uint8_t dcmi_image_buffer_memory1 = 2;
 volatile uint8_t dcmi_image_buffer_unused = 3;
+volatile uint8_t dcmi_image_buffer_loaned = 0; // bit (n - 1) set if buffer n is lent to the main loop
 volatile uint8_t calibration_used;
 volatile uint8_t calibration_unused;
 volatile uint8_t calibration_mem0;
 volatile uint8_t calibration_mem1;
 
-/* image buffers */
-uint8_t dcmi_image_buffer_8bit_1[FULL_IMAGE_SIZE];
-uint8_t dcmi_image_buffer_8bit_2[FULL_IMAGE_SIZE];
-uint8_t dcmi_image_buffer_8bit_3[FULL_IMAGE_SIZE];
+/*
+ * image buffers, three full images or five smaller ones carved from the same memory.
+ * With five buffers two are lent to the main loop as current and previous image,
+ * two are the DMA targets and one always stays free for the next swap.
+ */
+#define DCMI_BUFFERS		3
+#define DCMI_BUFFERS_LOANED	5
+#define DCMI_BUFFER_BIT(n)	(1 << ((n) - 1))
+
+uint8_t dcmi_image_buffer_pool[DCMI_BUFFERS * FULL_IMAGE_SIZE] __attribute__((aligned(4)));
+uint16_t dcmi_image_buffer_size = FULL_IMAGE_SIZE;
+uint8_t dcmi_image_buffer_count = DCMI_BUFFERS;
+uint32_t dcmi_pipeline_frame_counter = 0; // frame_counter when the last frame was lent while arriving
+
+/* frame time stamps, at the middle of the exposure */
+volatile uint32_t dcmi_image_buffer_time[DCMI_BUFFERS_LOANED]; // of the frame in buffer n at index n - 1
+volatile uint32_t dcmi_exposure_offset_us = 0; // from the last row back to the middle of the frame exposure
+uint32_t image_time = 0; // of the last image handed out
+uint8_t image_time_pending = 0; // buffer number of a lent frame which was not stamped yet
 
 uint32_t time_between_images;
 
 /* extern functions */
-extern uint32_t get_boot_time_us(void);
+extern uint64_t get_boot_time_us(void);
 extern void delay(unsigned msec);
 
+/**
+ * @brief Address of DCMI image buffer n (1 based)
+ */
+static uint8_t *dcmi_image_buffer(uint8_t n)
+{
+	return &dcmi_image_buffer_pool[(n - 1) * dcmi_image_buffer_size];
+}
+
+/**
+ * @brief Number of the DCMI image buffer at an address
+ *
+ * @return 1 based buffer number, 0 for other buffers like the fast RAM images
+ */
+static uint8_t dcmi_image_buffer_number(const uint8_t *image)
+{
+	for (uint8_t n = 1; n <= dcmi_image_buffer_count; n++)
+	{
+		if (image == dcmi_image_buffer(n))
+		{
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Buffer for the next DMA transfer, neither a DMA target nor lent
+ *
+ * The last frame is given up if it was not taken, at most
+ * DCMI_BUFFERS_LOANED - 3 buffers are lent so there is always one.
+ */
+static uint8_t dcmi_image_buffer_free(void)
+{
+	if (!(dcmi_image_buffer_loaned & DCMI_BUFFER_BIT(dcmi_image_buffer_unused)))
+	{
+		return dcmi_image_buffer_unused;
+	}
+
+	for (uint8_t n = 1; n <= dcmi_image_buffer_count; n++)
+	{
+		if (n != dcmi_image_buffer_memory0 && n != dcmi_image_buffer_memory1 &&
+				n != dcmi_image_buffer_unused && !(dcmi_image_buffer_loaned & DCMI_BUFFER_BIT(n)))
+		{
+			return n;
+		}
+	}
+
+	return dcmi_image_buffer_unused;
+}
+
+/**
+ * @brief Number of the DCMI image buffer the DMA writes to now
+ */
+static uint8_t dcmi_image_buffer_target(void)
+{
+	return DMA_GetCurrentMemoryTarget(DMA2_Stream1) ? dcmi_image_buffer_memory1 : dcmi_image_buffer_memory0;
+}
+
 /**
  * @brief Initialize DCMI DMA and enable image capturing
  */
@@ -146,6 +224,10 @@ void DMA2_Stream1_IRQHandler(void)
 		DMA_ClearITPendingBit(DMA2_Stream1, DMA_IT_TCIF1);
 		frame_counter++;
 
+		/* the DMA has moved on from the buffer with the complete frame */
+		uint8_t completed = DMA_GetCurrentMemoryTarget(DMA2_Stream1) ? dcmi_image_buffer_memory0 : dcmi_image_buffer_memory1;
+		dcmi_image_buffer_time[completed - 1] = get_boot_time_us() - dcmi_exposure_offset_us;
+
 		if (FLOAT_AS_BOOL(global_data.param[PARAM_VIDEO_ONLY]))
 		{
 			if (frame_counter >= 4)
@@ -179,34 +261,25 @@ void DMA2_Stream1_IRQHandler(void)
  */
 void dma_swap_buffers(void)
 {
+	uint8_t free_buffer = dcmi_image_buffer_free();
+	uint8_t *free_image = dcmi_image_buffer(free_buffer);
+
 	/* check which buffer is in use */
 	if (DMA_GetCurrentMemoryTarget(DMA2_Stream1))
 	{
 		/* swap dcmi image buffer */
-		if (dcmi_image_buffer_unused == 1)
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_1, DMA_Memory_0);
-		else if (dcmi_image_buffer_unused == 2)
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_2, DMA_Memory_0);
-		else
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_3, DMA_Memory_0);
+		DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) free_image, DMA_Memory_0);
 
-		int tmp_buffer = dcmi_image_buffer_memory0;
-		dcmi_image_buffer_memory0 = dcmi_image_buffer_unused;
-		dcmi_image_buffer_unused = tmp_buffer;
+		dcmi_image_buffer_unused = dcmi_image_buffer_memory0;
+		dcmi_image_buffer_memory0 = free_buffer;
 	}
 	else
 	{
 		/* swap dcmi image buffer */
-		if (dcmi_image_buffer_unused == 1)
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_1, DMA_Memory_1);
-		else if (dcmi_image_buffer_unused == 2)
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_2, DMA_Memory_1);
-		else
-			DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) dcmi_image_buffer_8bit_3, DMA_Memory_1);
+		DMA_MemoryTargetConfig(DMA2_Stream1, (uint32_t) free_image, DMA_Memory_1);
 
-		int tmp_buffer = dcmi_image_buffer_memory1;
-		dcmi_image_buffer_memory1 = dcmi_image_buffer_unused;
-		dcmi_image_buffer_unused = tmp_buffer;
+		dcmi_image_buffer_unused = dcmi_image_buffer_memory1;
+		dcmi_image_buffer_memory1 = free_buffer;
 	}
 
 	/* set next time_between_images */
@@ -236,8 +309,144 @@ uint32_t get_frame_counter(void){
 	return frame_counter;
 }
 
+uint32_t get_skipped_frame_counter(void){
+	return skipped_frame_counter;
+}
+
+float get_image_gradient(void){
+	return image_gradient;
+}
+
+/**
+ * @brief Time stamp of the last image, at the middle of its exposure
+ */
+uint32_t get_image_time(void){
+	/* a frame lent while arriving is stamped when it is complete */
+	if (image_time_pending && dcmi_image_buffer_time[image_time_pending - 1] != 0)
+	{
+		image_time = dcmi_image_buffer_time[image_time_pending - 1];
+		image_time_pending = 0;
+	}
+
+	return image_time;
+}
+
+/**
+ * @brief Reads the exposure of the sensor for the frame time stamps
+ *
+ * The stamp is taken when the last row has arrived. With the rolling shutter
+ * every row is exposed right before it is read out, so the middle of the
+ * exposure of the whole frame is that of its middle row: half the readout
+ * and half the exposure before the stamp. The AEC adapts the exposure
+ * slowly, so it is read at a low rate.
+ */
+void dcmi_update_exposure(void)
+{
+	const float row_time = mt9v034_get_row_time_us();
+	const uint16_t rows = global_data.param[PARAM_IMAGE_HEIGHT];
+
+	dcmi_exposure_offset_us = row_time * (rows + mt9v034_get_exposure_rows()) / 2.0f;
+}
+
+/**
+ * @brief Bytes the DMA has written to its current target
+ */
+static uint32_t dcmi_image_received(void)
+{
+	const uint32_t remaining = 4 * DMA_GetCurrDataCounter(DMA2_Stream1);
+
+	/* NDTR is reloaded with the full count when the DMA moves on to the next buffer */
+	return remaining < dcmi_image_buffer_size ? dcmi_image_buffer_size - remaining : 0;
+}
+
+/**
+ * @brief Waits until the first bytes of an image are written
+ *
+ * Only a frame lent while it arrives (BFLOW_PIPELINE) can be incomplete, it
+ * is complete as soon as the DMA has moved on to the next buffer.
+ *
+ * @param image image buffer
+ * @param size number of bytes needed from the start of the image
+ */
+void dcmi_wait_image(const uint8_t *image, uint32_t size)
+{
+	while (image == dcmi_image_buffer(dcmi_image_buffer_target()) && dcmi_image_received() < size) {
+            PROBE_1(false);
+            uavcan_run();
+            PROBE_1(true);
+	}
+}
+
+/**
+ * @brief Sum up the horizontal pixel steps of an image
+ *
+ * @param src image
+ * @param image_size number of pixels, a multiple of four
+ *
+ * @return sum of the absolute differences of all neighbouring pixels
+ */
+static uint32_t compute_image_gradient(const uint8_t *src, uint16_t image_size)
+{
+	uint32_t gradient = 0;
+
+	for (uint16_t pixel = 0; pixel + 4 < image_size; pixel += 4)
+	{
+		gradient = __USADA8(*((const uint32_t*) &src[pixel]), *((const uint32_t*) &src[pixel + 1]), gradient);
+	}
+
+	return gradient;
+}
+
+/**
+ * @brief Copy an image and sum up its horizontal pixel steps on the way
+ *
+ * @param dst destination buffer
+ * @param src source buffer
+ * @param image_size number of pixels, a multiple of four
+ *
+ * @return sum of the absolute differences of all neighbouring pixels
+ */
+static uint32_t copy_image(uint8_t *dst, const uint8_t *src, uint16_t image_size)
+{
+	uint32_t gradient = 0;
+
+	for (uint16_t pixel = 0; pixel < image_size; pixel += 4)
+	{
+		uint32_t word = *((const uint32_t*) &src[pixel]);
+		*((uint32_t*) &dst[pixel]) = word;
+
+		/* the pixels one to the right, the step from one row to the next is counted as well */
+		if (pixel + 4 < image_size)
+		{
+			gradient = __USADA8(word, *((const uint32_t*) &src[pixel + 1]), gradient);
+		}
+	}
+
+	return gradient;
+}
+
+/**
+ * @brief Takes over the time stamp of a complete frame
+ *
+ * The time between images comes from the stamps once there are two, the
+ * interrupt timing of dma_swap_buffers is only the fallback.
+ *
+ * @param n buffer number of the frame
+ */
+static void set_image_time(uint8_t n)
+{
+	uint32_t stamp = dcmi_image_buffer_time[n - 1];
+
+	time_between_images = (image_time != 0 && stamp != 0) ? stamp - image_time : time_between_next_images;
+	image_time = stamp;
+	image_time_pending = 0;
+}
+
 /**
- * @brief Copy image to fast RAM address
+ * @brief Copy image to fast RAM address, or lend it to the caller
+ *
+ * If five image buffers fit, the new image is not copied. The buffer it is in
+ * is lent to the caller until the image is replaced by a later call.
  *
  * @param current_image Current image buffer
  * @param previous_image Previous image buffer
@@ -251,8 +460,79 @@ void dma_copy_image_buffers(uint8_t ** current_image, uint8_t ** previous_image,
 	*current_image = *previous_image;
 	*previous_image = tmp_image;
 
+	/* the census transform of the overwritten buffer is not valid anymore */
+	flow_invalidate_image(*current_image);
+
+	/* a lent buffer goes back to the DMA */
+	uint8_t returned = dcmi_image_buffer_number(*current_image);
+
+	if (returned)
+	{
+		__disable_irq();
+		dcmi_image_buffer_loaned &= ~DCMI_BUFFER_BIT(returned);
+		__enable_irq();
+	}
+
 TODO(NB dma_copy_image_buffers is calling uavcan_run());
 
+	/* lend the frame the DMA writes now, compute_flow waits for its rows */
+	if (dcmi_image_buffer_count == DCMI_BUFFERS_LOANED && FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_PIPELINE]))
+	{
+		uint8_t lent = 0;
+
+		/* the DMA has to start a new frame first if it still writes the last one */
+		while (!lent) {
+			__disable_irq();
+			uint8_t target = dcmi_image_buffer_target();
+
+			if (!(dcmi_image_buffer_loaned & DCMI_BUFFER_BIT(target)))
+			{
+				dcmi_image_buffer_loaned |= DCMI_BUFFER_BIT(target);
+				lent = target;
+			}
+			__enable_irq();
+
+			if (!lent) {
+				PROBE_1(false);
+				uavcan_run();
+				PROBE_1(true);
+			}
+		}
+
+		/* frames which completed since the last one was lent, all but one are lost */
+		uint32_t frames = frame_counter - dcmi_pipeline_frame_counter;
+		dcmi_pipeline_frame_counter = frame_counter;
+
+		if (frames > 1)
+		{
+			skipped_frame_counter += frames - 1;
+		}
+
+		image_counter = 0;
+		time_between_images = (frames > 1 ? frames : 1) * cycle_time;
+
+		*current_image = dcmi_image_buffer(lent);
+		flow_invalidate_image(*current_image);
+
+		/* stamped by the transfer complete interrupt */
+		__disable_irq();
+		dcmi_image_buffer_time[lent - 1] = 0;
+		__enable_irq();
+		image_time_pending = lent;
+
+		/* the gradient needs the whole frame, this gives up the head start */
+		uint32_t gradient = 0;
+
+		if (global_data.param[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD] > 0.0f)
+		{
+			dcmi_wait_image(*current_image, image_size);
+			gradient = compute_image_gradient(*current_image, image_size);
+		}
+
+		image_gradient = (float) gradient / image_size;
+		return;
+	}
+
 	/* wait for new image if needed */
 	while(image_counter < image_step) {
             PROBE_1(false);
@@ -260,27 +540,44 @@ TODO(NB dma_copy_image_buffers is calling uavcan_run());
             PROBE_1(true);
 	}
 
+	/* images which arrived while the last one was processed are lost */
+	skipped_frame_counter += image_counter - image_step;
 	image_counter = 0;
 
-	/* time between images */
-	time_between_images = time_between_next_images;
+	/* the mean gradient of the image tells compute_flow if the frame has any texture */
+	uint32_t gradient = 0;
 
-	/* copy image */
-	if (dcmi_image_buffer_unused == 1)
-	{
-		for (uint16_t pixel = 0; pixel < image_size; pixel++)
-			(*current_image)[pixel] = (uint8_t)(dcmi_image_buffer_8bit_1[pixel]);
-	}
-	else if (dcmi_image_buffer_unused == 2)
+	if (dcmi_image_buffer_count == DCMI_BUFFERS_LOANED)
 	{
-		for (uint16_t pixel = 0; pixel < image_size; pixel++)
-			(*current_image)[pixel] = (uint8_t)(dcmi_image_buffer_8bit_2[pixel]);
+		/* the DMA does not write to the buffer until it is returned */
+		__disable_irq();
+		uint8_t lent = dcmi_image_buffer_unused;
+		dcmi_image_buffer_loaned |= DCMI_BUFFER_BIT(lent);
+		__enable_irq();
+
+		set_image_time(lent);
+		*current_image = dcmi_image_buffer(lent);
+		flow_invalidate_image(*current_image);
+
+		/* without the copy, the gradient is an extra pass over the image */
+		if (global_data.param[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD] > 0.0f)
+		{
+			gradient = compute_image_gradient(*current_image, image_size);
+		}
 	}
 	else
 	{
-		for (uint16_t pixel = 0; pixel < image_size; pixel++)
-			(*current_image)[pixel] = (uint8_t)(dcmi_image_buffer_8bit_3[pixel]);
+		/*
+		 * copy image, only full images for video and calibration get here. This stays
+		 * a CPU copy as the fast RAM (CCM) is not on the bus matrix and no DMA stream
+		 * can write to it, a memory to memory transfer would have to target SRAM.
+		 */
+		uint8_t source = dcmi_image_buffer_unused;
+		set_image_time(source);
+		gradient = copy_image(*current_image, dcmi_image_buffer(source), image_size);
 	}
+
+	image_gradient = (float) gradient / image_size;
 }
 
 /**
@@ -332,33 +629,14 @@ void send_calibration_image(uint8_t ** image_buffer_fast_1, uint8_t ** image_buf
 		}
 		else if (image == 2)
 		{
-			if (calibration_unused == 1)
-				frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_1[i % FULL_IMAGE_SIZE];
-			else if (calibration_unused == 2)
-				frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_2[i % FULL_IMAGE_SIZE];
-			else
-				frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_3[i % FULL_IMAGE_SIZE];
+			frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer(calibration_unused)[i % FULL_IMAGE_SIZE];
 		}
 		else
 		{
 			if (calibration_used)
-			{
-				if (calibration_mem0 == 1)
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_1[i % FULL_IMAGE_SIZE];
-				else if (calibration_mem0 == 2)
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_2[i % FULL_IMAGE_SIZE];
-				else
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_3[i % FULL_IMAGE_SIZE];
-			}
+				frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer(calibration_mem0)[i % FULL_IMAGE_SIZE];
 			else
-			{
-				if (calibration_mem1 == 1)
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_1[i % FULL_IMAGE_SIZE];
-				else if (calibration_mem1 == 2)
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_2[i % FULL_IMAGE_SIZE];
-				else
-					frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer_8bit_3[i % FULL_IMAGE_SIZE];
-			}
+				frame_buffer[i % MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = dcmi_image_buffer(calibration_mem1)[i % FULL_IMAGE_SIZE];
 		}
 	}
 
@@ -484,13 +762,9 @@ void dcmi_clock_init()
  */
 void dcmi_hw_init(void)
 {
-	uint16_t image_size = global_data.param[PARAM_IMAGE_WIDTH] * global_data.param[PARAM_IMAGE_HEIGHT];
-
 	/* Reset image buffers */
-	for (int i = 0; i < image_size; i++) {
-		dcmi_image_buffer_8bit_1 [i] = 0;
-		dcmi_image_buffer_8bit_2 [i] = 0;
-		dcmi_image_buffer_8bit_3 [i] = 0;
+	for (unsigned i = 0; i < sizeof(dcmi_image_buffer_pool); i++) {
+		dcmi_image_buffer_pool[i] = 0;
 	}
 
 	GPIO_InitTypeDef GPIO_InitStructure;
@@ -593,8 +867,35 @@ void dcmi_dma_init(uint16_t buffer_size)
 {
 	reset_frame_counter();
 
+	/* smaller images are lent to the main loop if five of them fit, full images are copied */
+	if (buffer_size * DCMI_BUFFERS_LOANED <= sizeof(dcmi_image_buffer_pool))
+	{
+		dcmi_image_buffer_size = buffer_size;
+		dcmi_image_buffer_count = DCMI_BUFFERS_LOANED;
+	}
+	else
+	{
+		dcmi_image_buffer_size = FULL_IMAGE_SIZE;
+		dcmi_image_buffer_count = DCMI_BUFFERS;
+	}
+
+	dcmi_image_buffer_memory0 = 1;
+	dcmi_image_buffer_memory1 = 2;
+	dcmi_image_buffer_unused = 3;
+	dcmi_image_buffer_loaned = 0;
+	dcmi_pipeline_frame_counter = 0;
+	image_time = 0;
+	image_time_pending = 0;
+
+	for (uint8_t n = 0; n < DCMI_BUFFERS_LOANED; n++)
+	{
+		dcmi_image_buffer_time[n] = 0;
+	}
+
 	DCMI_InitTypeDef DCMI_InitStructure;
 	DMA_InitTypeDef DMA_InitStructure;
+	uint8_t *memory0_image = dcmi_image_buffer(1);
+	uint8_t *memory1_image = dcmi_image_buffer(2);
 
 	/*** Configures the DCMI to interface with the mt9v034 camera module ***/
 	/* Enable DCMI clock */
@@ -618,7 +919,7 @@ void dcmi_dma_init(uint16_t buffer_size)
 
 	DMA_InitStructure.DMA_Channel = DMA_Channel_1;
 	DMA_InitStructure.DMA_PeripheralBaseAddr = DCMI_DR_ADDRESS;
-	DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) dcmi_image_buffer_8bit_1;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) memory0_image;
 	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
 	DMA_InitStructure.DMA_BufferSize = buffer_size / 4; // buffer size in date unit (word)
 	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
@@ -632,7 +933,7 @@ void dcmi_dma_init(uint16_t buffer_size)
 	DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
 	DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
 
-	DMA_DoubleBufferModeConfig(DMA2_Stream1,(uint32_t) dcmi_image_buffer_8bit_2, DMA_Memory_0);
+	DMA_DoubleBufferModeConfig(DMA2_Stream1,(uint32_t) memory1_image, DMA_Memory_0);
 	DMA_DoubleBufferModeCmd(DMA2_Stream1,ENABLE);
 
 	/* DCMI configuration */
@@ -44,83 +44,111 @@
 #include <mavlink.h>
 #include "dcmi.h"
 #include "debug.h"
+#include "simd.h"
+#include "flow.h"
+#include "main.h"
 
-#define __INLINE inline
-#define __ASM asm
-#include "core_cm4_simd.h"
-
-#define FRAME_SIZE	global_data.param[PARAM_IMAGE_WIDTH]
 #define SEARCH_SIZE	global_data.param[PARAM_MAX_FLOW_PIXEL] // maximum offset to search: 4 + 1/2 pixels
 #define TILE_SIZE	8               						// x & y tile size
 #define NUM_BLOCKS	5 // x & y number of tiles to check
+#define FRAME_MAX_SIZE	128 // largest supported image width & height
+#define SELECTION_STEP	(TILE_SIZE / 2) // grid spacing of tile candidates for the tile selection
+#define SELECTION_MAX	((FRAME_MAX_SIZE / SELECTION_STEP) * (FRAME_MAX_SIZE / SELECTION_STEP))
+#define MODEL_ITERATIONS	16 // RANSAC hypotheses of the motion model
+#define MODEL_INLIER_DIST	1.0f // max. distance of a tile vector from the model in pixels
+#define HIST_MAX_SIZE	(2 * (4 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE + 3) + 1) // half pixel shifts of the pyramid search window
 
 #define sign(x) (( x > 0 ) - ( x < 0 ))
 
-uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rate, float z_rate, float *pixel_flow_x, float *pixel_flow_y);
+
+/* search offsets ordered by rings around the window center */
+#define SPIRAL_SIZE ((2 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE + 1) * (2 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE + 1))
+static int8_t spiral_x[SPIRAL_SIZE];
+static int8_t spiral_y[SPIRAL_SIZE];
+static int16_t spiral_radius = -1;
+
+/* centers (relative to the image center) and flow of the accepted tiles */
+static float tile_px[NUM_BLOCKS * NUM_BLOCKS];
+static float tile_py[NUM_BLOCKS * NUM_BLOCKS];
+static float tile_vx[NUM_BLOCKS * NUM_BLOCKS];
+static float tile_vy[NUM_BLOCKS * NUM_BLOCKS];
+
+/* motion model of the last frame */
+static flow_model_t flow_model;
+
+/* match results of all tiles of the last call */
+static flow_tile_t flow_field[NUM_BLOCKS * NUM_BLOCKS];
+static uint16_t flow_field_count = 0;
+
+/* tiles dropped by the compute budget in the last call */
+static uint16_t flow_budget_dropped = 0;
+
+#define PYRAMID_SIZE		((FRAME_MAX_SIZE / 2) * (FRAME_MAX_SIZE / 2))
+#define SUBPIXEL_PLANES		3
+#define SUBPIXEL_PLANE_SIZE	(BOTTOM_FLOW_IMAGE_WIDTH * BOTTOM_FLOW_IMAGE_HEIGHT)
+#define CENSUS_PLANE_SIZE	(BOTTOM_FLOW_IMAGE_WIDTH * BOTTOM_FLOW_IMAGE_HEIGHT)
+#define WINDOW_SUM_SIZE		(BOTTOM_FLOW_IMAGE_WIDTH * BOTTOM_FLOW_IMAGE_HEIGHT)
+
+/*
+ * buffers of the matchers, a call matches either by SAD (pyramid and half pixel
+ * planes), census or ZSAD, so they share the memory
+ */
+static union
+{
+	struct
+	{
+		/* half resolution images for the coarse-to-fine search */
+		uint8_t pyramid1[PYRAMID_SIZE];
+		uint8_t pyramid2[PYRAMID_SIZE];
+		/* half pixel interpolated planes of image2: horizontal, vertical and diagonal */
+		uint8_t subpixel_planes[SUBPIXEL_PLANES][SUBPIXEL_PLANE_SIZE];
+	} sad;
+	/* census transformed images, the one of image2 is reused as image1 of the next call */
+	uint8_t census_planes[2][CENSUS_PLANE_SIZE];
+	/* sums of the 8x8 windows of image2 at every upper left corner, for ZSAD matching */
+	uint16_t window_sums[WINDOW_SUM_SIZE];
+} match_buffers;
+
+static uint8_t census_index = 0; // plane of census_image
+static const uint8_t *census_image = NULL; // cleared when another matcher uses the buffers
+static uint16_t census_row_size;
+static uint16_t census_rows;
+
+static uint16_t window_columns[FRAME_MAX_SIZE]; // sums of 8 pixels below every pixel of the current row
+static const uint8_t *window_sum_image = NULL;
+
+/* plane and pixel offset of the eight subpixel directions of compute_subpixel */
+static const uint8_t subpixel_plane[8] = { 0, 2, 1, 2, 0, 2, 1, 2 };
+static const int8_t subpixel_dx[8] = { 0, 0, 0, -1, -1, -1, 0, 0 };
+static const int8_t subpixel_dy[8] = { 0, 0, 0, 0, 0, -1, -1, -1 };
+
+/*
+ * SAD of two 8x8 pixel windows at a fixed row stride, stride has to be a
+ * literal number so the row offsets become immediates of the loads
+ */
+#if defined(__ARM_FEATURE_DSP)
+#define ABSDIFF_ROW(stride, n) \
+  "ldr r4, [%[src], #(" #stride " * " #n ")]\n"        /* read data from address + offset*/ \
+  "ldr r5, [%[dst], #(" #stride " * " #n ")]\n" \
+  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
+  "ldr r4, [%[src], #(" #stride " * " #n " + 4)]\n"        /* read data from address + offset */ \
+  "ldr r5, [%[dst], #(" #stride " * " #n " + 4)]\n" \
+  "usada8 %[result], r4, r5, %[result]\n"      /* difference */
 
 // compliments of Adam Williams
-#define ABSDIFF(frame1, frame2) \
+#define ABSDIFF(frame1, frame2, stride) \
 ({ \
  int result = 0; \
  asm volatile( \
   "mov %[result], #0\n"           /* accumulator */ \
- \
-  "ldr r4, [%[src], #0]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #0]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #4]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #4]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 1)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 1)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 1 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 1 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 2)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 2)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 2 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 2 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 3)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 3)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 3 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 3 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 4)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 4 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 4 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 5)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 5)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 5 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 5 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 6)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 6)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 6 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 6 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
-  "ldr r4, [%[src], #(64 * 7)]\n"        /* read data from address + offset*/ \
-  "ldr r5, [%[dst], #(64 * 7)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
-  "ldr r4, [%[src], #(64 * 7 + 4)]\n"        /* read data from address + offset */ \
-  "ldr r5, [%[dst], #(64 * 7 + 4)]\n" \
-  "usada8 %[result], r4, r5, %[result]\n"      /* difference */ \
- \
+  ABSDIFF_ROW(stride, 0) \
+  ABSDIFF_ROW(stride, 1) \
+  ABSDIFF_ROW(stride, 2) \
+  ABSDIFF_ROW(stride, 3) \
+  ABSDIFF_ROW(stride, 4) \
+  ABSDIFF_ROW(stride, 5) \
+  ABSDIFF_ROW(stride, 6) \
+  ABSDIFF_ROW(stride, 7) \
   : [result] "+r" (result) \
   : [src] "r" (frame1), [dst] "r" (frame2) \
   : "r4", "r5" \
@@ -128,6 +156,28 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
   \
  result; \
 })
+#elif defined(SIMD_SSE2)
+#define ABSDIFF(frame1, frame2, stride) simd_sad_8x8((frame1), (frame2), (stride))
+#else
+/* portable equivalent of the usada8 sequence above */
+#define ABSDIFF_ROW(frame1, frame2, stride, n) \
+ result = __USADA8(*((uint32_t*) &(frame1)[(stride) * n + 0]), *((uint32_t*) &(frame2)[(stride) * n + 0]), result); \
+ result = __USADA8(*((uint32_t*) &(frame1)[(stride) * n + 4]), *((uint32_t*) &(frame2)[(stride) * n + 4]), result)
+
+#define ABSDIFF(frame1, frame2, stride) \
+({ \
+ uint32_t result = 0; \
+ ABSDIFF_ROW(frame1, frame2, stride, 0); \
+ ABSDIFF_ROW(frame1, frame2, stride, 1); \
+ ABSDIFF_ROW(frame1, frame2, stride, 2); \
+ ABSDIFF_ROW(frame1, frame2, stride, 3); \
+ ABSDIFF_ROW(frame1, frame2, stride, 4); \
+ ABSDIFF_ROW(frame1, frame2, stride, 5); \
+ ABSDIFF_ROW(frame1, frame2, stride, 6); \
+ ABSDIFF_ROW(frame1, frame2, stride, 7); \
+ result; \
+})
+#endif
 
 /**
  * @brief Computes the Hessian at a pixel location
@@ -185,6 +235,28 @@ static inline uint32_t compute_diff(uint8_t *image, uint16_t offX, uint16_t offY
 {
 	/* calculate position in image buffer */
 	uint16_t off = (offY + 2) * row_size + (offX + 2); // we calc only the 4x4 pattern
+
+#if defined(SIMD_SSE2)
+	/* the 4 rows of the pattern and the same rows one pixel to the right */
+	const uint32_t r0 = *((uint32_t*) &image[off + 0 + 0 * row_size]);
+	const uint32_t r1 = *((uint32_t*) &image[off + 0 + 1 * row_size]);
+	const uint32_t r2 = *((uint32_t*) &image[off + 0 + 2 * row_size]);
+	const uint32_t r3 = *((uint32_t*) &image[off + 0 + 3 * row_size]);
+	const uint32_t h0 = *((uint32_t*) &image[off + 1 + 0 * row_size]);
+	const uint32_t h1 = *((uint32_t*) &image[off + 1 + 1 * row_size]);
+	const uint32_t h2 = *((uint32_t*) &image[off + 1 + 2 * row_size]);
+	const uint32_t h3 = *((uint32_t*) &image[off + 1 + 3 * row_size]);
+
+	/* row diff: rows 0..2 against rows 1..3 */
+	__m128i sad = _mm_sad_epu8(_mm_set_epi32(0, (int) r2, (int) r1, (int) r0), _mm_set_epi32(0, (int) r3, (int) r2, (int) r1));
+
+	/* column diff: the 3 neighbouring column pairs are the horizontal steps within each row */
+	const __m128i cols = _mm_set1_epi32(0x00FFFFFF);
+	sad = _mm_add_epi64(sad, _mm_sad_epu8(_mm_and_si128(_mm_set_epi32((int) r3, (int) r2, (int) r1, (int) r0), cols),
+			_mm_and_si128(_mm_set_epi32((int) h3, (int) h2, (int) h1, (int) h0), cols)));
+
+	return simd_sad_sum(sad);
+#else
 	uint32_t acc;
 
 	/* calc row diff */
@@ -204,7 +276,117 @@ static inline uint32_t compute_diff(uint8_t *image, uint16_t offX, uint16_t offY
 	acc = __USADA8(col3, col4, acc);
 
 	return acc;
+#endif
+}
+
+/**
+ * @brief Shi-Tomasi corner score of an 8x8 pixel pattern
+ *
+ * Smaller eigenvalue of the structure tensor built from the horizontal and
+ * vertical pixel steps. Unlike compute_diff it stays low on straight edges,
+ * where block matching is ambiguous along the edge.
+ *
+ * @param image ...
+ * @param offX x coordinate of upper left corner of 8x8 pattern in image
+ * @param offY y coordinate of upper left corner of 8x8 pattern in image
+ */
+static inline float compute_shi_tomasi(uint8_t *image, uint16_t offX, uint16_t offY, uint16_t row_size)
+{
+	int32_t gxx = 0;
+	int32_t gyy = 0;
+	int32_t gxy = 0;
+
+	for (uint16_t y = 0; y < TILE_SIZE - 1; y++)
+	{
+		uint8_t *row = &image[(offY + y) * row_size + offX];
+
+		for (uint16_t x = 0; x < TILE_SIZE - 1; x++)
+		{
+			int32_t gx = row[x + 1] - row[x];
+			int32_t gy = row[x + row_size] - row[x];
+
+			gxx += gx * gx;
+			gyy += gy * gy;
+			gxy += gx * gy;
+		}
+	}
+
+	float half_trace = (gxx + gyy) / 2.0f;
+	float half_diff = (gxx - gyy) / 2.0f;
+
+	return half_trace - sqrtf(half_diff * half_diff + (float) gxy * gxy);
+}
+
+/**
+ * @brief Select the best textured, non-overlapping tiles of an image
+ *
+ * Tile candidates are placed every SELECTION_STEP pixels and ranked by
+ * their Shi-Tomasi score. Tiles are taken greedily from the best score on,
+ * dropping all candidates which overlap an already selected tile.
+ *
+ * @param image image buffer
+ * @param pixLo first allowed tile coordinate
+ * @param pixHi tile coordinates have to be smaller than this
+ * @param row_size image width
+ * @param tile_x array to store the x coordinates of the selected tiles
+ * @param tile_y array to store the y coordinates of the selected tiles
+ * @param max_tiles maximum number of tiles to select
+ *
+ * @return number of selected tiles
+ */
+static uint16_t select_tiles(uint8_t *image, uint16_t pixLo, uint16_t pixHi, uint16_t row_size, uint16_t *tile_x, uint16_t *tile_y, uint16_t max_tiles)
+{
+	/* only touched by the CPU, in the core coupled memory like the frame copies of main.c */
+	static float score[SELECTION_MAX] __attribute__((section(".ccm")));
+	static uint16_t cand_x[SELECTION_MAX] __attribute__((section(".ccm")));
+	static uint16_t cand_y[SELECTION_MAX] __attribute__((section(".ccm")));
+	uint16_t cand_count = 0;
+	uint16_t count = 0;
+
+	for (uint16_t y = pixLo; y < pixHi; y += SELECTION_STEP)
+	{
+		for (uint16_t x = pixLo; x < pixHi && cand_count < SELECTION_MAX; x += SELECTION_STEP)
+		{
+			cand_x[cand_count] = x;
+			cand_y[cand_count] = y;
+			score[cand_count] = compute_shi_tomasi(image, x, y, row_size);
+			cand_count++;
+		}
+	}
 
+	while (count < max_tiles)
+	{
+		/* best remaining candidate */
+		int16_t best = -1;
+
+		for (uint16_t k = 0; k < cand_count; k++)
+		{
+			if (score[k] >= 0.0f && (best < 0 || score[k] > score[best]))
+			{
+				best = k;
+			}
+		}
+
+		if (best < 0)
+		{
+			break;
+		}
+
+		tile_x[count] = cand_x[best];
+		tile_y[count] = cand_y[best];
+		count++;
+
+		/* remove all candidates overlapping the new tile (including itself) */
+		for (uint16_t k = 0; k < cand_count; k++)
+		{
+			if (abs(cand_x[k] - cand_x[best]) < TILE_SIZE && abs(cand_y[k] - cand_y[best]) < TILE_SIZE)
+			{
+				score[k] = -1.0f;
+			}
+		}
+	}
+
+	return count;
 }
 
 /**
@@ -224,6 +406,56 @@ static inline uint32_t compute_subpixel(uint8_t *image1, uint8_t *image2, uint16
 	uint16_t off1 = off1Y * row_size + off1X; // image1
 	uint16_t off2 = off2Y * row_size + off2X; // image2
 
+#if defined(SIMD_SSE2)
+	/*
+	 * same subpixel layout as below, but with two full 8 pixel lines
+	 * per iteration instead of two columns of 4 pixels
+	 */
+	__m128i sad[8];
+
+	for (uint16_t k = 0; k < 8; k++)
+	{
+		sad[k] = _mm_setzero_si128();
+	}
+
+	for (uint16_t i = 0; i < 8; i += 2)
+	{
+		const uint8_t *p2 = &image2[off2 + i * row_size];
+
+		__m128i a  = simd_load_rows_8x2(p2, row_size);
+		__m128i ar = simd_load_rows_8x2(p2 + 1, row_size);
+		__m128i al = simd_load_rows_8x2(p2 - 1, row_size);
+		__m128i b  = simd_load_rows_8x2(p2 + row_size, row_size);
+		__m128i br = simd_load_rows_8x2(p2 + row_size + 1, row_size);
+		__m128i bl = simd_load_rows_8x2(p2 + row_size - 1, row_size);
+		__m128i c  = simd_load_rows_8x2(p2 - row_size, row_size);
+		__m128i cr = simd_load_rows_8x2(p2 - row_size + 1, row_size);
+		__m128i cl = simd_load_rows_8x2(p2 - row_size - 1, row_size);
+
+		__m128i v0 = simd_uhadd_epu8(a, ar);
+		__m128i v1 = simd_uhadd_epu8(b, br);
+		__m128i v3 = simd_uhadd_epu8(b, bl);
+		__m128i v4 = simd_uhadd_epu8(a, al);
+		__m128i v5 = simd_uhadd_epu8(c, cl);
+		__m128i v7 = simd_uhadd_epu8(c, cr);
+
+		__m128i ref = simd_load_rows_8x2(&image1[off1 + i * row_size], row_size);
+
+		sad[0] = _mm_add_epi64(sad[0], _mm_sad_epu8(ref, v0));
+		sad[1] = _mm_add_epi64(sad[1], _mm_sad_epu8(ref, simd_uhadd_epu8(v0, v1)));
+		sad[2] = _mm_add_epi64(sad[2], _mm_sad_epu8(ref, simd_uhadd_epu8(a, b)));
+		sad[3] = _mm_add_epi64(sad[3], _mm_sad_epu8(ref, simd_uhadd_epu8(v3, v4)));
+		sad[4] = _mm_add_epi64(sad[4], _mm_sad_epu8(ref, v4));
+		sad[5] = _mm_add_epi64(sad[5], _mm_sad_epu8(ref, simd_uhadd_epu8(v4, v5)));
+		sad[6] = _mm_add_epi64(sad[6], _mm_sad_epu8(ref, simd_uhadd_epu8(a, c)));
+		sad[7] = _mm_add_epi64(sad[7], _mm_sad_epu8(ref, simd_uhadd_epu8(v7, v0)));
+	}
+
+	for (uint16_t k = 0; k < 8; k++)
+	{
+		acc[k] = simd_sad_sum(sad[k]);
+	}
+#else
 	uint32_t s0, s1, s2, s3, s4, s5, s6, s7, t1, t3, t5, t7;
 
 	for (uint16_t i = 0; i < 8; i++)
@@ -320,73 +552,1146 @@ static inline uint32_t compute_subpixel(uint8_t *image1, uint8_t *image2, uint16
 		s6 = (__UHADD8(*((uint32_t*) &image2[off2 + 4 + (i+0) * row_size]), *((uint32_t*) &image2[off2 + 4 + (i-1) * row_size])));
 		s7 = (__UHADD8(*((uint32_t*) &image2[off2 + 4 + (i-1) * row_size]), *((uint32_t*) &image2[off2 + 5 + (i-1) * row_size])));
 
-		t1 = (__UHADD8(s0, s1));
-		t3 = (__UHADD8(s3, s4));
-		t5 = (__UHADD8(s4, s5));
-		t7 = (__UHADD8(s7, s0));
+		t1 = (__UHADD8(s0, s1));
+		t3 = (__UHADD8(s3, s4));
+		t5 = (__UHADD8(s4, s5));
+		t7 = (__UHADD8(s7, s0));
+
+		acc[0] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s0, acc[0]);
+		acc[1] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t1, acc[1]);
+		acc[2] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s2, acc[2]);
+		acc[3] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t3, acc[3]);
+		acc[4] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s4, acc[4]);
+		acc[5] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t5, acc[5]);
+		acc[6] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s6, acc[6]);
+		acc[7] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t7, acc[7]);
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * @brief Compute SAD of two 8x8 pixel windows.
+ *
+ * @param image1 ...
+ * @param image2 ...
+ * @param off1X x coordinate of upper left corner of pattern in image1
+ * @param off1Y y coordinate of upper left corner of pattern in image1
+ * @param off2X x coordinate of upper left corner of pattern in image2
+ * @param off2Y y coordinate of upper left corner of pattern in image2
+ */
+static inline uint32_t compute_sad_8x8(uint8_t *image1, uint8_t *image2, uint16_t off1X, uint16_t off1Y, uint16_t off2X, uint16_t off2Y, uint16_t row_size)
+{
+	/* calculate position in image buffer */
+	uint16_t off1 = off1Y * row_size + off1X; // image1
+	uint16_t off2 = off2Y * row_size + off2X; // image2
+
+#if defined(SIMD_SSE2)
+	return simd_sad_8x8(&image1[off1], &image2[off2], row_size);
+#else
+	uint32_t acc;
+	acc = __USAD8 (*((uint32_t*) &image1[off1 + 0 + 0 * row_size]), *((uint32_t*) &image2[off2 + 0 + 0 * row_size]));
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 0 * row_size]), *((uint32_t*) &image2[off2 + 4 + 0 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 1 * row_size]), *((uint32_t*) &image2[off2 + 0 + 1 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 1 * row_size]), *((uint32_t*) &image2[off2 + 4 + 1 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 2 * row_size]), *((uint32_t*) &image2[off2 + 0 + 2 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 2 * row_size]), *((uint32_t*) &image2[off2 + 4 + 2 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 3 * row_size]), *((uint32_t*) &image2[off2 + 0 + 3 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 3 * row_size]), *((uint32_t*) &image2[off2 + 4 + 3 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 4 * row_size]), *((uint32_t*) &image2[off2 + 0 + 4 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 4 * row_size]), *((uint32_t*) &image2[off2 + 4 + 4 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 5 * row_size]), *((uint32_t*) &image2[off2 + 0 + 5 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 5 * row_size]), *((uint32_t*) &image2[off2 + 4 + 5 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 6 * row_size]), *((uint32_t*) &image2[off2 + 0 + 6 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 6 * row_size]), *((uint32_t*) &image2[off2 + 4 + 6 * row_size]), acc);
+
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 7 * row_size]), *((uint32_t*) &image2[off2 + 0 + 7 * row_size]), acc);
+	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 7 * row_size]), *((uint32_t*) &image2[off2 + 4 + 7 * row_size]), acc);
+
+	return acc;
+#endif
+}
+
+/**
+ * @brief SAD of two 8x8 pixel windows for any image width
+ *
+ * The common image widths use ABSDIFF with constant row offsets, all others
+ * the generic kernel. row_size does not change during a search, so the
+ * compiler moves this switch out of the search loops.
+ *
+ * @param base1 upper left corner of the pattern in image1
+ * @param base2 upper left corner of the pattern in image2
+ * @param row_size image width
+ */
+static inline uint32_t compute_sad_8x8_stride(uint8_t *base1, uint8_t *base2, uint16_t row_size)
+{
+	switch (row_size)
+	{
+		case 64:
+			return ABSDIFF(base1, base2, 64);
+		case 96:
+			return ABSDIFF(base1, base2, 96);
+		case 128:
+			return ABSDIFF(base1, base2, 128);
+		default:
+			return compute_sad_8x8(base1, base2, 0, 0, 0, 0, row_size);
+	}
+}
+
+/**
+ * @brief Interpolate the half pixel planes of an image
+ *
+ * Plane 0 holds the average of every pixel and its right neighbour, plane 1
+ * of every pixel and the one below and plane 2 the vertical average of
+ * plane 0. The averages are the same as in compute_subpixel, so the
+ * subpixel SADs of both are equal. The last two rows and the last column
+ * are not valid.
+ *
+ * @param image image buffer
+ * @param row_size image width, a multiple of four
+ * @param rows image height
+ */
+static void compute_subpixel_planes(uint8_t *image, uint16_t row_size, uint16_t rows)
+{
+	for (uint16_t y = 0; y < rows - 2; y++)
+	{
+		uint8_t *a = &image[y * row_size];
+		uint8_t *b = &image[(y + 1) * row_size];
+		uint8_t *h = &match_buffers.sad.subpixel_planes[0][y * row_size];
+		uint8_t *v = &match_buffers.sad.subpixel_planes[1][y * row_size];
+		uint8_t *d = &match_buffers.sad.subpixel_planes[2][y * row_size];
+		uint16_t x = 0;
+
+#if defined(SIMD_SSE2)
+		for (; x + 16 <= row_size; x += 16)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i*) &a[x]);
+			__m128i b0 = _mm_loadu_si128((const __m128i*) &b[x]);
+			__m128i ha = simd_uhadd_epu8(a0, _mm_loadu_si128((const __m128i*) &a[x + 1]));
+			__m128i hb = simd_uhadd_epu8(b0, _mm_loadu_si128((const __m128i*) &b[x + 1]));
+
+			_mm_storeu_si128((__m128i*) &h[x], ha);
+			_mm_storeu_si128((__m128i*) &v[x], simd_uhadd_epu8(a0, b0));
+			_mm_storeu_si128((__m128i*) &d[x], simd_uhadd_epu8(ha, hb));
+		}
+#endif
+
+		for (; x < row_size; x += 4)
+		{
+			uint32_t a0 = *((uint32_t*) &a[x]);
+			uint32_t b0 = *((uint32_t*) &b[x]);
+			uint32_t ha = __UHADD8(a0, *((uint32_t*) &a[x + 1]));
+			uint32_t hb = __UHADD8(b0, *((uint32_t*) &b[x + 1]));
+
+			*((uint32_t*) &h[x]) = ha;
+			*((uint32_t*) &v[x]) = __UHADD8(a0, b0);
+			*((uint32_t*) &d[x]) = __UHADD8(ha, hb);
+		}
+	}
+}
+
+/**
+ * @brief Compute SAD distances of subpixel shifts from the half pixel planes
+ *
+ * Same result as compute_subpixel, but every direction is a plain SAD
+ * on the planes built by compute_subpixel_planes.
+ *
+ * @param image1 ...
+ * @param off1X x coordinate of upper left corner of pattern in image1
+ * @param off1Y y coordinate of upper left corner of pattern in image1
+ * @param off2X x coordinate of upper left corner of pattern in image2
+ * @param off2Y y coordinate of upper left corner of pattern in image2
+ * @param acc array to store SAD distances for shift in every direction
+ * @param row_size image width
+ */
+static inline void compute_subpixel_cached(uint8_t *image1, uint16_t off1X, uint16_t off1Y, uint16_t off2X, uint16_t off2Y, uint32_t *acc, uint16_t row_size)
+{
+	for (uint16_t k = 0; k < 8; k++)
+	{
+		acc[k] = compute_sad_8x8(image1, match_buffers.sad.subpixel_planes[subpixel_plane[k]], off1X, off1Y,
+				off2X + subpixel_dx[k], off2Y + subpixel_dy[k], row_size);
+	}
+}
+
+/**
+ * @brief Census transform of an image
+ *
+ * Every pixel becomes the 8 bit string of its 3x3 neighbourhood, bit k set
+ * if neighbour k is darker than the pixel. It only depends on the order of
+ * the brightness values, so exposure and gain changes keep it unchanged.
+ * Four pixels are compared at once, the sign bit of the halving
+ * subtraction is the comparison result. The border pixels are 0.
+ *
+ * @param image image buffer
+ * @param census census buffer of the same size
+ * @param row_size image width
+ * @param rows image height
+ */
+static void compute_census_plane(uint8_t *image, uint8_t *census, uint16_t row_size, uint16_t rows)
+{
+	for (uint16_t x = 0; x < row_size; x++)
+	{
+		census[x] = 0;
+		census[(rows - 1) * row_size + x] = 0;
+	}
+
+	for (uint16_t y = 1; y < rows - 1; y++)
+	{
+		uint8_t *a = &image[(y - 1) * row_size];
+		uint8_t *c = &image[y * row_size];
+		uint8_t *b = &image[(y + 1) * row_size];
+		uint8_t *out = &census[y * row_size];
+		uint16_t x = 1;
+
+		for (; x + 4 < row_size; x += 4)
+		{
+			uint32_t center = *((uint32_t*) &c[x]);
+			uint32_t bits;
+
+			bits  = (__UHSUB8(*((uint32_t*) &a[x - 1]), center) & 0x80808080) >> 7;
+			bits |= (__UHSUB8(*((uint32_t*) &a[x + 0]), center) & 0x80808080) >> 6;
+			bits |= (__UHSUB8(*((uint32_t*) &a[x + 1]), center) & 0x80808080) >> 5;
+			bits |= (__UHSUB8(*((uint32_t*) &c[x - 1]), center) & 0x80808080) >> 4;
+			bits |= (__UHSUB8(*((uint32_t*) &c[x + 1]), center) & 0x80808080) >> 3;
+			bits |= (__UHSUB8(*((uint32_t*) &b[x - 1]), center) & 0x80808080) >> 2;
+			bits |= (__UHSUB8(*((uint32_t*) &b[x + 0]), center) & 0x80808080) >> 1;
+			bits |= (__UHSUB8(*((uint32_t*) &b[x + 1]), center) & 0x80808080);
+
+			*((uint32_t*) &out[x]) = bits;
+		}
+
+		for (; x < row_size - 1; x++)
+		{
+			out[x] = (a[x - 1] < c[x]) | (a[x] < c[x]) << 1 | (a[x + 1] < c[x]) << 2 |
+					(c[x - 1] < c[x]) << 3 | (c[x + 1] < c[x]) << 4 |
+					(b[x - 1] < c[x]) << 5 | (b[x] < c[x]) << 6 | (b[x + 1] < c[x]) << 7;
+		}
+
+		out[0] = 0;
+		out[row_size - 1] = 0;
+	}
+}
+
+/**
+ * @brief Census transforms of both images
+ *
+ * image2 of one call is image1 of the next, so its transform is kept
+ * and only image2 is transformed in a continuous stream of frames.
+ *
+ * @param image1 ...
+ * @param image2 ...
+ * @param row_size image width
+ * @param rows image height
+ * @param census1 returns the census of image1
+ * @param census2 returns the census of image2
+ */
+static void compute_census_planes(uint8_t *image1, uint8_t *image2, uint16_t row_size, uint16_t rows, uint8_t **census1, uint8_t **census2)
+{
+	if (census_image != image1 || census_row_size != row_size || census_rows != rows)
+	{
+		compute_census_plane(image1, match_buffers.census_planes[census_index], row_size, rows);
+	}
+
+	*census1 = match_buffers.census_planes[census_index];
+
+	census_index ^= 1;
+	compute_census_plane(image2, match_buffers.census_planes[census_index], row_size, rows);
+	*census2 = match_buffers.census_planes[census_index];
+
+	census_image = image2;
+	census_row_size = row_size;
+	census_rows = rows;
+}
+
+/**
+ * @brief Hamming distance of two 8x8 census windows
+ *
+ * The Cortex-M4 has no popcount, the bits of four census bytes are
+ * counted in parallel and the byte counts summed by usad8 at the end.
+ *
+ * @param base1 upper left corner of the window in the census of image1
+ * @param base2 upper left corner of the window in the census of image2
+ * @param row_size image width
+ */
+static inline uint32_t compute_hamming_8x8(uint8_t *base1, uint8_t *base2, uint16_t row_size)
+{
+	uint32_t counts = 0; // bit counts per byte, at most 16 * 8
+
+	for (uint16_t row = 0; row < 8; row++)
+	{
+		for (uint16_t col = 0; col < 8; col += 4)
+		{
+			uint32_t x = *((uint32_t*) &base1[row * row_size + col]) ^ *((uint32_t*) &base2[row * row_size + col]);
+
+			x = x - ((x >> 1) & 0x55555555);
+			x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+			counts += (x + (x >> 4)) & 0x0F0F0F0F;
+		}
+	}
+
+	return __USAD8(counts, 0);
+}
+
+/**
+ * @brief Sums of all 8x8 windows of an image
+ *
+ * Running sums over 8 rows per column and 8 columns per row, so every
+ * window sum costs a few additions instead of 64. Only windows inside
+ * the image are valid.
+ *
+ * @param image image buffer
+ * @param row_size image width, at most FRAME_MAX_SIZE
+ * @param rows image height
+ */
+static void compute_window_sums(uint8_t *image, uint16_t row_size, uint16_t rows)
+{
+	uint16_t *columns = window_columns;
+
+	for (uint16_t x = 0; x < row_size; x++)
+	{
+		columns[x] = 0;
+
+		for (uint16_t y = 0; y < TILE_SIZE; y++)
+		{
+			columns[x] += image[y * row_size + x];
+		}
+	}
+
+	for (uint16_t y = 0; y + TILE_SIZE <= rows; y++)
+	{
+		uint16_t *sums = &match_buffers.window_sums[y * row_size];
+		uint16_t sum = 0;
+
+		for (uint16_t x = 0; x < TILE_SIZE; x++)
+		{
+			sum += columns[x];
+		}
+
+		sums[0] = sum;
+
+		for (uint16_t x = TILE_SIZE; x < row_size; x++)
+		{
+			sum += columns[x] - columns[x - TILE_SIZE];
+			sums[x - TILE_SIZE + 1] = sum;
+		}
+
+		/* move the columns down by one row */
+		if (y + TILE_SIZE < rows)
+		{
+			for (uint16_t x = 0; x < row_size; x++)
+			{
+				columns[x] += image[(y + TILE_SIZE) * row_size + x] - image[y * row_size + x];
+			}
+		}
+	}
+
+	window_sum_image = image;
+}
+
+/**
+ * @brief Sum of the pixels of an 8x8 window
+ *
+ * @param base upper left corner of the window
+ * @param row_size image width
+ */
+static inline uint32_t compute_sum_8x8(uint8_t *base, uint16_t row_size)
+{
+	uint32_t acc = 0;
+
+	for (uint16_t row = 0; row < 8; row++)
+	{
+		acc = __USADA8(*((uint32_t*) &base[row * row_size]), 0, acc);
+		acc = __USADA8(*((uint32_t*) &base[row * row_size + 4]), 0, acc);
+	}
+
+	return acc;
+}
+
+/**
+ * @brief Zero mean SAD of two 8x8 windows
+ *
+ * The darker window is brightened by the difference of the window means
+ * with a saturating add, the rest is the usada8 loop of a plain SAD.
+ *
+ * @param base1 upper left corner of the window in image1
+ * @param base2 upper left corner of the window in image2
+ * @param row_size image width
+ * @param sum1 pixel sum of the window in image1
+ * @param sum2 pixel sum of the window in image2
+ */
+static inline uint32_t compute_zsad_8x8(uint8_t *base1, uint8_t *base2, uint16_t row_size, uint32_t sum1, uint32_t sum2)
+{
+	const bool brighten2 = sum1 > sum2;
+	const uint32_t delta = ((brighten2 ? sum1 - sum2 : sum2 - sum1) + 32) / 64;
+	uint32_t acc = 0;
+
+#if defined(SIMD_SSE2)
+	const __m128i offset = _mm_set1_epi8((char) delta);
+	__m128i sad = _mm_setzero_si128();
+
+	for (uint16_t row = 0; row < 8; row += 2)
+	{
+		__m128i a = simd_load_rows_8x2(base1 + row * row_size, row_size);
+		__m128i b = simd_load_rows_8x2(base2 + row * row_size, row_size);
+
+		if (brighten2)
+		{
+			b = _mm_adds_epu8(b, offset);
+		}
+		else
+		{
+			a = _mm_adds_epu8(a, offset);
+		}
+
+		sad = _mm_add_epi64(sad, _mm_sad_epu8(a, b));
+	}
+
+	acc = simd_sad_sum(sad);
+#else
+	const uint32_t offset = delta * 0x01010101;
+
+	for (uint16_t row = 0; row < 8; row++)
+	{
+		for (uint16_t col = 0; col < 8; col += 4)
+		{
+			uint32_t a = *((uint32_t*) &base1[row * row_size + col]);
+			uint32_t b = *((uint32_t*) &base2[row * row_size + col]);
+
+			if (brighten2)
+			{
+				b = __UQADD8(b, offset);
+			}
+			else
+			{
+				a = __UQADD8(a, offset);
+			}
+
+			acc = __USADA8(a, b, acc);
+		}
+	}
+#endif
+
+	return acc;
+}
+
+/**
+ * @brief Block matching distance of two 8x8 windows
+ *
+ * @param base1 upper left corner of the window in image1 or its census
+ * @param base2 upper left corner of the window in image2 or its census
+ * @param row_size image width
+ * @param matcher BFLOW_MATCHER cost
+ * @param sum1 pixel sum of the window in image1, only used by ZSAD
+ */
+static inline uint32_t compute_match_8x8(uint8_t *base1, uint8_t *base2, uint16_t row_size, uint8_t matcher, uint32_t sum1)
+{
+	switch (matcher)
+	{
+		case MATCHER_CENSUS:
+			return compute_hamming_8x8(base1, base2, row_size);
+
+		case MATCHER_ZSAD:
+			/* the window sums are indexed like image2 */
+			return compute_zsad_8x8(base1, base2, row_size, sum1, match_buffers.window_sums[base2 - window_sum_image]);
+
+		default:
+			return compute_sad_8x8_stride(base1, base2, row_size);
+	}
+}
+
+/**
+ * @brief Checks if two search offsets belong to the same minimum
+ *
+ * The second best match of a tile is only taken from offsets which are not
+ * next to the best one, the neighbours of a minimum are always close to it.
+ */
+static inline bool offsets_adjacent(int8_t x1, int8_t y1, int8_t x2, int8_t y2)
+{
+	return abs(x1 - x2) <= 1 && abs(y1 - y2) <= 1;
+}
+
+/**
+ * @brief Ratio of the best to the second best distance of a tile
+ *
+ * Close to 1 if the tile matches at two places, like over repetitive textures.
+ */
+static inline float compute_ambiguity(uint32_t dist, uint32_t dist2)
+{
+	return dist2 > 0 ? (float) dist / (float) dist2 : 1.0f;
+}
+
+/**
+ * @brief Best and second best match of a tile search
+ *
+ * The offsets are relative to the center of the search window.
+ */
+typedef struct
+{
+	uint32_t dist;		///< best distance
+	uint32_t dist2;		///< second best distance, not next to the best one
+	int8_t x;		///< offset of the best distance
+	int8_t y;
+	int8_t x2;		///< offset of the second best distance
+	int8_t y2;
+} tile_match_t;
+
+/**
+ * @brief SAD of two 8x8 pixel windows with early termination
+ *
+ * Two rows are accumulated at a time and the computation stops as soon as
+ * the partial sum exceeds bound. The result is then only a lower bound
+ * of the SAD, but still larger than bound.
+ *
+ * @param base1 upper left corner of the pattern in image1
+ * @param base2 upper left corner of the pattern in image2
+ * @param row_size image width
+ * @param bound SAD of the best match so far
+ */
+static inline uint32_t compute_sad_8x8_bounded(uint8_t *base1, uint8_t *base2, uint16_t row_size, uint32_t bound)
+{
+	uint32_t acc = 0;
+
+#if defined(SIMD_SSE2)
+	__m128i sad = _mm_setzero_si128();
+
+	for (uint16_t row = 0; row < 8; row += 2)
+	{
+		sad = _mm_add_epi64(sad, _mm_sad_epu8(simd_load_rows_8x2(base1 + row * row_size, row_size),
+				simd_load_rows_8x2(base2 + row * row_size, row_size)));
+		acc = simd_sad_sum(sad);
+
+		if (acc > bound)
+		{
+			break;
+		}
+	}
+#else
+	for (uint16_t row = 0; row < 8; row += 2)
+	{
+		acc = __USADA8(*((uint32_t*) &base1[0 + (row+0) * row_size]), *((uint32_t*) &base2[0 + (row+0) * row_size]), acc);
+		acc = __USADA8(*((uint32_t*) &base1[4 + (row+0) * row_size]), *((uint32_t*) &base2[4 + (row+0) * row_size]), acc);
+		acc = __USADA8(*((uint32_t*) &base1[0 + (row+1) * row_size]), *((uint32_t*) &base2[0 + (row+1) * row_size]), acc);
+		acc = __USADA8(*((uint32_t*) &base1[4 + (row+1) * row_size]), *((uint32_t*) &base2[4 + (row+1) * row_size]), acc);
+
+		if (acc > bound)
+		{
+			break;
+		}
+	}
+#endif
+
+	return acc;
+}
+
+/**
+ * @brief Full search of a square window, the template of the search kernels
+ *
+ * Inlined with a constant radius and matcher, the loop bounds and the
+ * matcher dispatch are resolved at compile time.
+ *
+ * @param base1 tile in image1 (or its census plane)
+ * @param base2 center of the search window in image2
+ * @param row_size image width
+ * @param radius largest offset in each direction
+ * @param matcher FlowMatcher_TypeDef
+ * @param sum1 pixel sum of the tile for ZSAD matching
+ * @param match best and second best match
+ */
+static inline __attribute__((always_inline)) void search_window(uint8_t *base1, uint8_t *base2, uint16_t row_size,
+		int16_t radius, uint8_t matcher, uint32_t sum1, tile_match_t *match)
+{
+	uint32_t dist = 0xFFFFFFFF;
+	uint32_t dist2 = 0xFFFFFFFF;
+	int8_t sumx = 0;
+	int8_t sumy = 0;
+	int8_t sum2x = 0;
+	int8_t sum2y = 0;
+
+	for (int8_t jj = -radius; jj <= radius; jj++)
+	{
+		uint8_t *row2 = base2 + jj * row_size;
+
+		for (int8_t ii = -radius; ii <= radius; ii++)
+		{
+			uint32_t temp_dist = compute_match_8x8(base1, row2 + ii, row_size, matcher, sum1);
+			if (temp_dist < dist)
+			{
+				if (!offsets_adjacent(ii, jj, sumx, sumy))
+				{
+					dist2 = dist;
+					sum2x = sumx;
+					sum2y = sumy;
+				}
+				else if (offsets_adjacent(ii, jj, sum2x, sum2y))
+				{
+					/* the second best belongs to the new minimum */
+					dist2 = 0xFFFFFFFF;
+				}
+
+				sumx = ii;
+				sumy = jj;
+				dist = temp_dist;
+			}
+			else if (temp_dist < dist2 && !offsets_adjacent(ii, jj, sumx, sumy))
+			{
+				dist2 = temp_dist;
+				sum2x = ii;
+				sum2y = jj;
+			}
+		}
+	}
+
+	match->dist = dist;
+	match->dist2 = dist2;
+	match->x = sumx;
+	match->y = sumy;
+	match->x2 = sum2x;
+	match->y2 = sum2y;
+}
+
+/**
+ * @brief Spiral search of a square window with early termination, the template of the spiral kernels
+ *
+ * The offsets are visited from the window center outwards, SAD candidates are
+ * dropped as soon as their partial SAD is worse than the best one. Ties are
+ * resolved in favour of the first offset in row order, so the result is the
+ * same as of search_window. The ambiguity test needs the exact second best,
+ * so offsets away from the best one are only dropped once they are worse than
+ * the second best. Census and ZSAD distances are always computed in full.
+ *
+ * @param base1 tile in image1 (or its census plane)
+ * @param base2 center of the search window in image2
+ * @param row_size image width
+ * @param radius largest offset in each direction, the spiral has to be computed for at least this radius
+ * @param matcher FlowMatcher_TypeDef
+ * @param sum1 pixel sum of the tile for ZSAD matching
+ * @param ambiguity_check keep the exact second best distance
+ * @param match best and second best match
+ */
+static inline __attribute__((always_inline)) void search_spiral(uint8_t *base1, uint8_t *base2, uint16_t row_size,
+		int16_t radius, uint8_t matcher, uint32_t sum1, bool ambiguity_check, tile_match_t *match)
+{
+	const uint16_t count = (2 * radius + 1) * (2 * radius + 1);
+	uint32_t dist = 0xFFFFFFFF;
+	uint32_t dist2 = 0xFFFFFFFF;
+	int8_t sumx = 0;
+	int8_t sumy = 0;
+	int8_t sum2x = 0;
+	int8_t sum2y = 0;
+
+	for (uint16_t k = 0; k < count; k++)
+	{
+		const int8_t ii = spiral_x[k];
+		const int8_t jj = spiral_y[k];
+		const bool adjacent = offsets_adjacent(ii, jj, sumx, sumy);
+		uint8_t *candidate = base2 + jj * row_size + ii;
+		uint32_t temp_dist = (matcher != MATCHER_SAD) ? compute_match_8x8(base1, candidate, row_size, matcher, sum1) :
+				compute_sad_8x8_bounded(base1, candidate, row_size, (ambiguity_check && !adjacent) ? dist2 : dist);
+
+		if (temp_dist < dist || (temp_dist == dist && (jj < sumy || (jj == sumy && ii < sumx))))
+		{
+			if (!adjacent)
+			{
+				dist2 = dist;
+				sum2x = sumx;
+				sum2y = sumy;
+			}
+			else if (offsets_adjacent(ii, jj, sum2x, sum2y))
+			{
+				/* the second best belongs to the new minimum */
+				dist2 = 0xFFFFFFFF;
+			}
+
+			sumx = ii;
+			sumy = jj;
+			dist = temp_dist;
+		}
+		else if (temp_dist < dist2 && !adjacent)
+		{
+			/* partial SAD if the candidate was dropped */
+			dist2 = temp_dist;
+			sum2x = ii;
+			sum2y = jj;
+		}
+	}
+
+	match->dist = dist;
+	match->dist2 = dist2;
+	match->x = sumx;
+	match->y = sumy;
+	match->x2 = sum2x;
+	match->y2 = sum2y;
+}
+
+/**
+ * @brief Full search of a window of any radius and image width, without a kernel
+ */
+static void search_window_any(uint8_t *base1, uint8_t *base2, uint16_t row_size,
+		int16_t radius, uint8_t matcher, uint32_t sum1, tile_match_t *match)
+{
+	search_window(base1, base2, row_size, radius, matcher, sum1, match);
+}
+
+/**
+ * @brief Spiral search of a window of any radius and image width, without a kernel
+ */
+static void search_spiral_any(uint8_t *base1, uint8_t *base2, uint16_t row_size,
+		int16_t radius, uint8_t matcher, uint32_t sum1, bool ambiguity_check, tile_match_t *match)
+{
+	search_spiral(base1, base2, row_size, radius, matcher, sum1, ambiguity_check, match);
+}
+
+typedef void (*search_kernel_t)(uint8_t *base1, uint8_t *base2, uint32_t sum1, bool ambiguity_check, tile_match_t *match);
+
+/*
+ * full and spiral search kernels of a matcher for a constant radius at the
+ * bottom flow image width, the row offsets of the SAD are constants as well
+ */
+#define SEARCH_KERNELS(name, matcher, radius) \
+	static void search_##name##_##radius(uint8_t *base1, uint8_t *base2, uint32_t sum1, bool ambiguity_check, tile_match_t *match) \
+	{ search_window(base1, base2, BOTTOM_FLOW_IMAGE_WIDTH, radius, matcher, sum1, match); } \
+	static void spiral_##name##_##radius(uint8_t *base1, uint8_t *base2, uint32_t sum1, bool ambiguity_check, tile_match_t *match) \
+	{ search_spiral(base1, base2, BOTTOM_FLOW_IMAGE_WIDTH, radius, matcher, sum1, ambiguity_check, match); }
+
+/* BFLOW_MAX_PIX is fixed to the window size, the compute budget halves it */
+#if BOTTOM_FLOW_SEARCH_WINDOW_SIZE != 4
+#error "the search kernels are generated for a search window size of 4"
+#endif
+
+SEARCH_KERNELS(sad, MATCHER_SAD, 4)
+SEARCH_KERNELS(census, MATCHER_CENSUS, 4)
+SEARCH_KERNELS(zsad, MATCHER_ZSAD, 4)
+SEARCH_KERNELS(sad, MATCHER_SAD, 2)
+SEARCH_KERNELS(census, MATCHER_CENSUS, 2)
+SEARCH_KERNELS(zsad, MATCHER_ZSAD, 2)
+
+#define SEARCH_KERNEL_RADII	2
+
+static const int16_t search_kernel_radius[SEARCH_KERNEL_RADII] = {4, 2};
+
+/* indexed by the radius, full (0) or spiral (1) search and FlowMatcher_TypeDef */
+static const search_kernel_t search_kernels[SEARCH_KERNEL_RADII][2][3] =
+{
+	{
+		{search_sad_4, search_census_4, search_zsad_4},
+		{spiral_sad_4, spiral_census_4, spiral_zsad_4},
+	},
+	{
+		{search_sad_2, search_census_2, search_zsad_2},
+		{spiral_sad_2, spiral_census_2, spiral_zsad_2},
+	},
+};
+
+/**
+ * @brief Picks the search kernel of a radius, matcher and image width
+ *
+ * @param spiral spiral search with early termination
+ *
+ * @return the kernel, NULL if there is none and search_window_any or search_spiral_any has to be used
+ */
+static search_kernel_t get_search_kernel(int16_t radius, uint8_t matcher, uint16_t row_size, bool spiral)
+{
+	if (matcher > MATCHER_ZSAD || row_size != BOTTOM_FLOW_IMAGE_WIDTH)
+	{
+		return NULL;
+	}
+
+	for (uint8_t k = 0; k < SEARCH_KERNEL_RADII; k++)
+	{
+		if (search_kernel_radius[k] == radius)
+		{
+			return search_kernels[k][spiral ? 1 : 0][matcher];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Subpixel position of a SAD minimum from a parabola fit
+ *
+ * @param left SAD at the best integer shift - 1
+ * @param center SAD at the best integer shift
+ * @param right SAD at the best integer shift + 1
+ *
+ * @return offset of the parabola vertex from the best shift, between -0.5 and 0.5
+ */
+static inline float compute_parabola(uint32_t left, uint32_t center, uint32_t right)
+{
+	int32_t curvature = (int32_t) left - 2 * (int32_t) center + (int32_t) right;
+
+	/* a flat or inverted SAD curve has no defined minimum */
+	if (curvature <= 0)
+	{
+		return 0.0f;
+	}
+
+	float offset = (float) ((int32_t) left - (int32_t) right) / (float) (2 * curvature);
+
+	if (offset < -0.5f) offset = -0.5f;
+	if (offset > 0.5f) offset = 0.5f;
+
+	return offset;
+}
+
+/**
+ * @brief Order all offsets of a search window by their distance to the center
+ *
+ * The offsets of ring r (max(|x|, |y|) == r) follow those of ring r - 1,
+ * so a search in this order finds good matches early.
+ *
+ * @param radius search window radius, at most BOTTOM_FLOW_SEARCH_WINDOW_SIZE
+ *
+ * @return number of offsets
+ */
+static uint16_t compute_spiral(int16_t radius)
+{
+	if (radius != spiral_radius)
+	{
+		uint16_t n = 0;
+
+		for (int16_t r = 0; r <= radius; r++)
+		{
+			for (int16_t y = -r; y <= r; y++)
+			{
+				for (int16_t x = -r; x <= r; x++)
+				{
+					if (abs(x) == r || abs(y) == r)
+					{
+						spiral_x[n] = x;
+						spiral_y[n] = y;
+						n++;
+					}
+				}
+			}
+		}
+
+		spiral_radius = radius;
+	}
+
+	return (2 * radius + 1) * (2 * radius + 1);
+}
+
+/**
+ * @brief Tile index of the n-th tile of a budgeted tile loop
+ *
+ * The even tiles come first and then the odd ones, so the tiles
+ * dropped at the end are spread over the whole image.
+ *
+ * @param n position in the loop
+ * @param count number of tiles
+ */
+static inline uint16_t compute_budget_order(uint16_t n, uint16_t count)
+{
+	const uint16_t even = (count + 1) / 2;
+
+	return (n < even) ? 2 * n : 2 * (n - even) + 1;
+}
+
+/**
+ * @brief Waits for the first size bytes of an image like dcmi_wait_image
+ *
+ * The readout of a pipelined frame takes most of the frame interval,
+ * the time spent waiting for it is not spent on the tiles.
+ *
+ * @param image image buffer
+ * @param size bytes to wait for
+ * @param budget true to measure the wait for the compute budget
+ *
+ * @return cycles spent waiting, 0 without budget
+ */
+static uint32_t budget_wait_image(const uint8_t *image, uint32_t size, bool budget)
+{
+	if (!budget)
+	{
+		dcmi_wait_image(image, size);
+		return 0;
+	}
+
+	const uint32_t start = get_cycle_count();
+	dcmi_wait_image(image, size);
+	return get_cycle_count() - start;
+}
+
+/**
+ * @brief Downsample an image by two in x and y direction
+ *
+ * Every pixel of the new level is the average of a 2x2 block,
+ * four input columns are processed at once with halving adds.
+ *
+ * @param image image buffer to downsample
+ * @param level buffer for the downsampled image, (row_size / 2) * (rows / 2) pixels
+ * @param row_size image width
+ * @param rows image height
+ */
+static void compute_pyramid_level(uint8_t *image, uint8_t *level, uint16_t row_size, uint16_t rows)
+{
+	for (uint16_t y = 0; y < rows / 2; y++)
+	{
+		uint8_t *out = &level[y * (row_size / 2)];
+
+		for (uint16_t x = 0; x < row_size; x += 4)
+		{
+			/* vertical average of the two rows, then of neighbouring pixels */
+			uint32_t v = __UHADD8(*((uint32_t*) &image[(2 * y + 0) * row_size + x]), *((uint32_t*) &image[(2 * y + 1) * row_size + x]));
+			uint32_t h = __UHADD8(v, v >> 8);
+
+			out[x / 2 + 0] = (uint8_t) (h >> 0);
+			out[x / 2 + 1] = (uint8_t) (h >> 16);
+		}
+	}
+}
+
+/**
+ * @brief Least squares similarity model of a set of flow vectors
+ *
+ * The model is v = t + [a -b; b a] p with the translation t at the image
+ * center, a the relative scale change and b the rotation (small angle).
+ *
+ * @param px x coordinates of the tiles relative to the image center
+ * @param py y coordinates of the tiles relative to the image center
+ * @param vx flow of the tiles in x
+ * @param vy flow of the tiles in y
+ * @param mask bit k selects vector k
+ * @param model array for tx, ty, a and b
+ */
+static void compute_similarity(const float *px, const float *py, const float *vx, const float *vy, uint32_t mask, float *model)
+{
+	float n = 0.0f;
+	float mpx = 0.0f, mpy = 0.0f, mvx = 0.0f, mvy = 0.0f;
+
+	for (uint16_t k = 0; k < NUM_BLOCKS * NUM_BLOCKS; k++)
+	{
+		if (mask & (1u << k))
+		{
+			mpx += px[k]; mpy += py[k]; mvx += vx[k]; mvy += vy[k];
+			n += 1.0f;
+		}
+	}
+
+	mpx /= n; mpy /= n; mvx /= n; mvy /= n;
+
+	float qq = 0.0f, sa = 0.0f, sb = 0.0f;
+
+	for (uint16_t k = 0; k < NUM_BLOCKS * NUM_BLOCKS; k++)
+	{
+		if (mask & (1u << k))
+		{
+			float qx = px[k] - mpx, qy = py[k] - mpy;
+			float wx = vx[k] - mvx, wy = vy[k] - mvy;
+			qq += qx * qx + qy * qy;
+			sa += qx * wx + qy * wy;
+			sb += qx * wy - qy * wx;
+		}
+	}
+
+	/* tiles at one spot only give the translation */
+	float a = qq > 1.0f ? sa / qq : 0.0f;
+	float b = qq > 1.0f ? sb / qq : 0.0f;
+
+	model[0] = mvx - (a * mpx - b * mpy);
+	model[1] = mvy - (b * mpx + a * mpy);
+	model[2] = a;
+	model[3] = b;
+}
+
+/**
+ * @brief Tiles consistent with a similarity model
+ *
+ * @return bit mask of the inliers
+ */
+static uint32_t compute_inliers(const float *px, const float *py, const float *vx, const float *vy, uint16_t count, const float *model)
+{
+	uint32_t mask = 0;
+
+	for (uint16_t k = 0; k < count; k++)
+	{
+		float ex = model[0] + model[2] * px[k] - model[3] * py[k] - vx[k];
+		float ey = model[1] + model[3] * px[k] + model[2] * py[k] - vy[k];
 
-		acc[0] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s0, acc[0]);
-		acc[1] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t1, acc[1]);
-		acc[2] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s2, acc[2]);
-		acc[3] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t3, acc[3]);
-		acc[4] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s4, acc[4]);
-		acc[5] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t5, acc[5]);
-		acc[6] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), s6, acc[6]);
-		acc[7] = __USADA8 ((*((uint32_t*) &image1[off1 + 4 + i * row_size])), t7, acc[7]);
+		if (ex * ex + ey * ey <= MODEL_INLIER_DIST * MODEL_INLIER_DIST)
+		{
+			mask |= 1u << k;
+		}
 	}
 
-	return 0;
+	return mask;
 }
 
 /**
- * @brief Compute SAD of two 8x8 pixel windows.
+ * @brief Fit a similarity model (translation, rotation, scale) with RANSAC
  *
- * @param image1 ...
- * @param image2 ...
- * @param off1X x coordinate of upper left corner of pattern in image1
- * @param off1Y y coordinate of upper left corner of pattern in image1
- * @param off2X x coordinate of upper left corner of pattern in image2
- * @param off2Y y coordinate of upper left corner of pattern in image2
+ * Hypotheses are computed from pairs of tiles in a fixed order, the one with
+ * the most inliers is refined by a least squares fit on its inliers.
+ *
+ * @param px x coordinates of the tiles relative to the image center
+ * @param py y coordinates of the tiles relative to the image center
+ * @param vx flow of the tiles in x
+ * @param vy flow of the tiles in y
+ * @param count number of tiles, at most NUM_BLOCKS * NUM_BLOCKS
+ * @param model array for tx, ty, a and b, see compute_similarity
+ *
+ * @return number of inliers
  */
-static inline uint32_t compute_sad_8x8(uint8_t *image1, uint8_t *image2, uint16_t off1X, uint16_t off1Y, uint16_t off2X, uint16_t off2Y, uint16_t row_size)
+static uint16_t compute_flow_model(const float *px, const float *py, const float *vx, const float *vy, uint16_t count, float *model)
 {
-	/* calculate position in image buffer */
-	uint16_t off1 = off1Y * row_size + off1X; // image1
-	uint16_t off2 = off2Y * row_size + off2X; // image2
+	uint32_t best_mask = 0;
+	uint16_t best_count = 0;
 
-	uint32_t acc;
-	acc = __USAD8 (*((uint32_t*) &image1[off1 + 0 + 0 * row_size]), *((uint32_t*) &image2[off2 + 0 + 0 * row_size]));
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 0 * row_size]), *((uint32_t*) &image2[off2 + 4 + 0 * row_size]), acc);
+	for (uint16_t k = 0; k < MODEL_ITERATIONS && count >= 2; k++)
+	{
+		/* pairs of tiles far apart in the list, so far apart in the image */
+		uint16_t first = (k * 7) % count;
+		uint16_t second = (first + count / 2 + k / 2) % count;
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 1 * row_size]), *((uint32_t*) &image2[off2 + 0 + 1 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 1 * row_size]), *((uint32_t*) &image2[off2 + 4 + 1 * row_size]), acc);
+		if (first == second)
+		{
+			continue;
+		}
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 2 * row_size]), *((uint32_t*) &image2[off2 + 0 + 2 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 2 * row_size]), *((uint32_t*) &image2[off2 + 4 + 2 * row_size]), acc);
+		float hypothesis[4];
+		compute_similarity(px, py, vx, vy, (1u << first) | (1u << second), hypothesis);
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 3 * row_size]), *((uint32_t*) &image2[off2 + 0 + 3 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 3 * row_size]), *((uint32_t*) &image2[off2 + 4 + 3 * row_size]), acc);
+		uint32_t mask = compute_inliers(px, py, vx, vy, count, hypothesis);
+		uint16_t inliers = 0;
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 4 * row_size]), *((uint32_t*) &image2[off2 + 0 + 4 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 4 * row_size]), *((uint32_t*) &image2[off2 + 4 + 4 * row_size]), acc);
+		for (uint16_t t = 0; t < count; t++)
+		{
+			inliers += (mask >> t) & 1u;
+		}
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 5 * row_size]), *((uint32_t*) &image2[off2 + 0 + 5 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 5 * row_size]), *((uint32_t*) &image2[off2 + 4 + 5 * row_size]), acc);
+		if (inliers > best_count)
+		{
+			best_mask = mask;
+			best_count = inliers;
+		}
+	}
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 6 * row_size]), *((uint32_t*) &image2[off2 + 0 + 6 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 6 * row_size]), *((uint32_t*) &image2[off2 + 4 + 6 * row_size]), acc);
+	if (best_count == 0)
+	{
+		model[0] = model[1] = model[2] = model[3] = 0.0f;
+		return 0;
+	}
 
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 0 + 7 * row_size]), *((uint32_t*) &image2[off2 + 0 + 7 * row_size]), acc);
-	acc = __USADA8(*((uint32_t*) &image1[off1 + 4 + 7 * row_size]), *((uint32_t*) &image2[off2 + 4 + 7 * row_size]), acc);
+	compute_similarity(px, py, vx, vy, best_mask, model);
 
-	return acc;
+	return best_count;
+}
+
+/**
+ * @brief Tiles the compute budget dropped in the last compute_flow call
+ */
+uint16_t get_flow_budget_dropped(void)
+{
+	return flow_budget_dropped;
+}
+
+/**
+ * @brief Gyro compensation of a flow measured over one frame
+ *
+ * Same as the compensation in compute_flow, for flows computed elsewhere
+ * from uncompensated compute_flow results. Nothing is clamped.
+ *
+ * @param x_rate gyro x rate
+ * @param y_rate gyro y rate
+ * @param pixel_flow_x flow in x direction, compensated in place
+ * @param pixel_flow_y flow in y direction, compensated in place
+ */
+void compensate_flow_gyro(float x_rate, float y_rate, float *pixel_flow_x, float *pixel_flow_y)
+{
+	const float focal_length_px = (global_data.param[PARAM_FOCAL_LENGTH_MM]) / (4.0f * 6.0f) * 1000.0f;
+
+	if (!FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_GYRO_COMPENSATION]))
+	{
+		return;
+	}
+
+	/* -y_rate gives x flow, x_rate gives y flow */
+	if (fabsf(y_rate) > global_data.param[PARAM_GYRO_COMPENSATION_THRESHOLD])
+	{
+		*pixel_flow_x += y_rate * (get_time_between_images() / 1000000.0f) * focal_length_px;
+	}
+
+	if (fabsf(x_rate) > global_data.param[PARAM_GYRO_COMPENSATION_THRESHOLD])
+	{
+		*pixel_flow_y -= x_rate * (get_time_between_images() / 1000000.0f) * focal_length_px;
+	}
+}
+
+/**
+ * @brief Drop the cached census transform of an image buffer
+ *
+ * compute_flow reuses the census transform of image2 when the same buffer is passed
+ * as image1 of the next call, so this has to be called whenever the
+ * content of an image buffer is replaced.
+ *
+ * @param image image buffer which is overwritten
+ */
+void flow_invalidate_image(const uint8_t *image)
+{
+	if (image == census_image)
+	{
+		census_image = NULL;
+	}
+}
+
+/**
+ * @brief Motion model of the last compute_flow call
+ */
+const flow_model_t *get_flow_model(void)
+{
+	return &flow_model;
+}
+
+/**
+ * @brief Tile field of the last compute_flow call
+ *
+ * @param count returns the number of tiles
+ */
+const flow_tile_t *get_flow_field(uint16_t *count)
+{
+	*count = flow_field_count;
+	return flow_field;
 }
 
 /**
  * @brief Computes pixel flow from image1 to image2
  *
  * Searches the corresponding position in the new image (image2) of max. 64 pixels from the old image (image1)
- * and calculates the average offset of all.
+ * and calculates the average offset of all. Images up to FRAME_MAX_SIZE pixels wide and high are supported,
+ * the SAD kernels are specialized for widths of 64, 96 and 128 pixels.
+ *
+ * With BFLOW_PYRAMID the search runs on half resolution images first and is
+ * refined by one pixel at full resolution, which extends the maximum flow
+ * from BFLOW_MAX_PIX to 2 * BFLOW_MAX_PIX + 1 pixels at about the same cost.
+ *
+ * With BFLOW_TILE_SEL the tiles are not placed on a fixed grid, but at the
+ * NUM_BLOCKS * NUM_BLOCKS best textured non-overlapping locations.
+ *
+ * With BFLOW_HALF_PEL the half pixel interpolations of image2 are computed
+ * once per frame for images up to 64x64 pixels and shared by all tiles.
+ * Finer interpolation steps only need more planes, not more work per tile.
+ *
+ * With BFLOW_PARABOLA the subpixel shift of every tile is the vertex of a
+ * parabola through the SADs of the best integer shift and its neighbours in
+ * x and y instead of the best of eight half pixel shifts. The result is not
+ * quantized to half pixels and needs four SADs instead of eight.
+ *
+ * With BFLOW_MODEL a similarity model (translation, rotation and scale) is
+ * fitted to the tile vectors with RANSAC. The translation at the image center
+ * is the flow, the number of inliers the quality. Rotation and scale change
+ * are available from get_flow_model.
+ *
+ * With BFLOW_GYRO_PRD (and no pyramid) the search window is centered on the
+ * shift predicted from x_rate and y_rate, which covers up to 2 * BFLOW_MAX_PIX
+ * pixels of flow as long as the rotation dominates it.
  *
  * @param image1 previous image buffer
  * @param image2 current image buffer (new)
@@ -399,58 +1704,317 @@ static inline uint32_t compute_sad_8x8(uint8_t *image1, uint8_t *image2, uint16_
 uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rate, float z_rate, float *pixel_flow_x, float *pixel_flow_y) {
 
 	/* constants */
-	const int16_t winmin = -SEARCH_SIZE;
-	const int16_t winmax = SEARCH_SIZE;
+	const uint16_t row_size = (uint16_t) global_data.param[PARAM_IMAGE_WIDTH];
+	const uint16_t rows = (uint16_t) global_data.param[PARAM_IMAGE_HEIGHT];
+	/* census planes and window sums are kept for the bottom flow image size */
+	const uint8_t matcher = (row_size * rows <= CENSUS_PLANE_SIZE) ? (uint8_t) global_data.param[PARAM_BOTTOM_FLOW_MATCHER] : MATCHER_SAD;
+	/* the coarse search works on pixel values, census and ZSAD matching are done at full resolution */
+	const bool pyramid = matcher == MATCHER_SAD && FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_PYRAMID]);
+	const bool gyro_prediction = !pyramid && FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_GYRO_PREDICTION]);
+	const int16_t search_size = SEARCH_SIZE;
+	const bool early_termination = FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION]) &&
+			search_size <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE;
+	/* cycles the tile loop may take, a share of the frame interval */
+	const uint32_t budget = global_data.param[PARAM_BOTTOM_FLOW_BUDGET] * get_time_between_images() * CYCLES_PER_US;
+	const uint32_t budget_start = budget > 0 ? get_cycle_count() : 0;
+	uint32_t budget_waited = 0; // cycles spent waiting for image2 since budget_start
+	const bool tile_selection = FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_TILE_SELECTION]);
+	const bool subpixel_cache = FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE]) &&
+			row_size * rows <= SUBPIXEL_PLANE_SIZE;
+	bool subpixel_planes_valid = false;
+	/* the half pixel interpolation is compared by SAD, other distances are fitted instead */
+	const bool parabolic = matcher != MATCHER_SAD || FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC]);
+	const bool model_fit = FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_MODEL]);
+	const float feature_threshold = global_data.param[PARAM_BOTTOM_FLOW_FEATURE_THRESHOLD];
+	const float value_threshold = global_data.param[PARAM_BOTTOM_FLOW_VALUE_THRESHOLD];
+	const float ambiguity_threshold = global_data.param[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD];
+	const bool ambiguity_check = ambiguity_threshold > 0.0f;
+
+	flow_model.rotation = 0.0f;
+	flow_model.divergence = 0.0f;
+	flow_model.inliers = 0;
+	flow_field_count = 0;
+	flow_budget_dropped = 0;
+
+	/*
+	 * the pyramid and tile selection buffers hold at most FRAME_MAX_SIZE x FRAME_MAX_SIZE pixels,
+	 * the histograms hold shifts of at most BOTTOM_FLOW_SEARCH_WINDOW_SIZE
+	 */
+	if (row_size > FRAME_MAX_SIZE || rows > FRAME_MAX_SIZE || search_size > BOTTOM_FLOW_SEARCH_WINDOW_SIZE)
+	{
+		/* image2 is complete when the flow returns */
+		dcmi_wait_image(image2, row_size * rows);
+		*pixel_flow_x = 0.0f;
+		*pixel_flow_y = 0.0f;
+		return 0;
+	}
+
+	/* a frame without texture fails the tile test everywhere, its gradient was taken while copying image2 */
+	if (get_image_gradient() < global_data.param[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD])
+	{
+		*pixel_flow_x = 0.0f;
+		*pixel_flow_y = 0.0f;
+		return 0;
+	}
+
+	int16_t winmin = -search_size;
+	int16_t winmax = search_size;
+
+	if (pyramid)
+	{
+		winmin = -(2 * search_size + 1);
+		winmax = 2 * search_size + 1;
+	}
+	else if (gyro_prediction)
+	{
+		/* the window center is moved by at most search_size */
+		winmin = -2 * search_size;
+		winmax = 2 * search_size;
+	}
+
 	const uint16_t hist_size = 2*(winmax-winmin+1)+1;
 
+	/* calculate focal_length in pixel */
+	const float focal_length_px = (global_data.param[PARAM_FOCAL_LENGTH_MM]) / (4.0f * 6.0f) * 1000.0f; //original focal lenght: 12mm pixelsize: 6um, binning 4 enabled
+
 	/* variables */
-        uint16_t pixLo = SEARCH_SIZE + 1;
-        uint16_t pixHi = FRAME_SIZE - (SEARCH_SIZE + 1) - TILE_SIZE;
+        /* pyramid: the coarse 8x8 tile covers the 16x16 neighbourhood of the tile and is shifted by search_size coarse pixels */
+        uint16_t pixLo = pyramid ? (TILE_SIZE / 2 + 2 * search_size) : (winmax + 1);
+        uint16_t pixHi = (row_size < rows ? row_size : rows) - pixLo - TILE_SIZE;
         uint16_t pixStep = (pixHi - pixLo) / NUM_BLOCKS + 1;
 	uint16_t i, j;
-	uint32_t acc[8]; // subpixels
-	uint16_t histx[hist_size]; // counter for x shift
-	uint16_t histy[hist_size]; // counter for y shift
-	int8_t  dirsx[64]; // shift directions in x
-	int8_t  dirsy[64]; // shift directions in y
-	uint8_t  subdirs[64]; // shift directions of best subpixels
+	/* static like the candidates of select_tiles, compute_flow has to stay within the stack frame limit */
+	static uint16_t tile_x[NUM_BLOCKS * NUM_BLOCKS]; // upper left corners of the tiles to match
+	static uint16_t tile_y[NUM_BLOCKS * NUM_BLOCKS];
+	uint16_t tile_count = 0;
+	static uint32_t acc[8]; // subpixels
+	static uint16_t histx[HIST_MAX_SIZE]; // counter for x shift
+	static uint16_t histy[HIST_MAX_SIZE]; // counter for y shift
 	float meanflowx = 0.0f;
 	float meanflowy = 0.0f;
 	uint16_t meancount = 0;
+	uint16_t inliers = 0; // tiles consistent with the flow
+	float ambiguity_sum = 0.0f; // of the accepted tiles
 	float histflowx = 0.0f;
 	float histflowy = 0.0f;
 
 	/* initialize with 0 */
 	for (j = 0; j < hist_size; j++) { histx[j] = 0; histy[j] = 0; }
 
+	/*
+	 * rotation of the camera moves the whole image, predict this shift from the gyro
+	 * and center the search window on it (same signs as the gyro compensation below)
+	 */
+	int8_t predx = 0;
+	int8_t predy = 0;
+
+	if (gyro_prediction)
+	{
+		float pred_x_pixel = - y_rate * (get_time_between_images() / 1000000.0f) * focal_length_px;
+		float pred_y_pixel = x_rate * (get_time_between_images() / 1000000.0f) * focal_length_px;
+
+		/* clamp to the range the tile borders allow */
+		if (pred_x_pixel < -search_size) pred_x_pixel = -search_size;
+		if (pred_x_pixel > search_size) pred_x_pixel = search_size;
+		if (pred_y_pixel < -search_size) pred_y_pixel = -search_size;
+		if (pred_y_pixel > search_size) pred_y_pixel = search_size;
+
+		predx = roundf(pred_x_pixel);
+		predy = roundf(pred_y_pixel);
+	}
+
+	/*
+	 * image2 may still be arriving (BFLOW_PIPELINE). Passes over the whole image
+	 * wait for all of it, the tiles only for the rows they search.
+	 */
+	if (pyramid || matcher != MATCHER_SAD)
+	{
+		budget_waited += budget_wait_image(image2, row_size * rows, budget > 0);
+	}
+
+	/* the buffers of the other matchers overlap the census planes */
+	if (matcher != MATCHER_CENSUS)
+	{
+		census_image = NULL;
+	}
+
+	/* build half resolution images */
+	if (pyramid)
+	{
+		compute_pyramid_level(image1, match_buffers.sad.pyramid1, row_size, rows);
+		compute_pyramid_level(image2, match_buffers.sad.pyramid2, row_size, rows);
+	}
+
+	/* images the block matching works on */
+	uint8_t *match1 = image1;
+	uint8_t *match2 = image2;
+
+	if (matcher == MATCHER_CENSUS)
+	{
+		compute_census_planes(image1, image2, row_size, rows, &match1, &match2);
+	}
+	else if (matcher == MATCHER_ZSAD)
+	{
+		compute_window_sums(image2, row_size, rows);
+	}
+
+	/* tiles to match, a regular grid or the best textured locations */
+	if (tile_selection)
+	{
+		tile_count = select_tiles(image1, pixLo, pixHi, row_size, tile_x, tile_y, NUM_BLOCKS * NUM_BLOCKS);
+	}
+	else
+	{
+		for (j = pixLo; j < pixHi; j += pixStep)
+		{
+			for (i = pixLo; i < pixHi; i += pixStep)
+			{
+				tile_x[tile_count] = i;
+				tile_y[tile_count] = j;
+				tile_count++;
+			}
+		}
+	}
+
+	flow_field_count = tile_count;
+
 	/* iterate over all patterns
 	 */
-	for (j = pixLo; j < pixHi; j += pixStep)
+	int16_t tile_search_size = search_size;
+	search_kernel_t search_kernel = get_search_kernel(tile_search_size, matcher, row_size, early_termination);
+
+	if (early_termination)
+	{
+		compute_spiral(search_size);
+	}
+
+	for (uint16_t n = 0; n < tile_count; n++)
 	{
-		for (i = pixLo; i < pixHi; i += pixStep)
+		/* with a budget every second tile comes first, so dropped tiles are spread over the image */
+		const uint16_t t = (budget == 0) ? n : compute_budget_order(n, tile_count);
+
+		if (budget > 0 && n > 0)
 		{
-			/* test pixel if it is suitable for flow tracking */
-			uint32_t diff = compute_diff(image1, i, j, (uint16_t) global_data.param[PARAM_IMAGE_WIDTH]);
-			if (diff < global_data.param[PARAM_BOTTOM_FLOW_FEATURE_THRESHOLD])
+			const uint32_t elapsed = get_cycle_count() - budget_start - budget_waited;
+			const uint32_t per_tile = elapsed / n;
+
+			/* stop before the next tile would miss the deadline */
+			if (elapsed + per_tile > budget)
+			{
+				flow_budget_dropped = tile_count - n;
+
+				for (; n < tile_count; n++)
+				{
+					const uint16_t d = compute_budget_order(n, tile_count);
+					flow_tile_t *tile = &flow_field[d];
+					tile->x = tile_x[d];
+					tile->y = tile_y[d];
+					tile->flow_x = 0;
+					tile->flow_y = 0;
+					tile->sad = FLOW_TILE_NO_SAD;
+					tile->sad2 = FLOW_TILE_NO_SAD;
+					tile->score = 0;
+				}
+
+				break;
+			}
+
+			/* the remaining tiles do not fit at this cost, search them in half the radius */
+			if (tile_search_size == search_size && search_size > 1 && elapsed + per_tile * (tile_count - n) > budget)
 			{
-				continue;
+				tile_search_size = search_size / 2;
+				search_kernel = get_search_kernel(tile_search_size, matcher, row_size, early_termination);
 			}
+		}
+
+		i = tile_x[t];
+		j = tile_y[t];
+
+		/* test pixel if it is suitable for flow tracking, every frame is scored here once as image1 */
+		uint32_t diff = compute_diff(image1, i, j, row_size);
 
-			uint32_t dist = 0xFFFFFFFF; // set initial distance to "infinity"
-			int8_t sumx = 0;
-			int8_t sumy = 0;
-			int8_t ii, jj;
+		flow_tile_t *tile = &flow_field[t];
+		tile->x = i;
+		tile->y = j;
+		tile->flow_x = 0;
+		tile->flow_y = 0;
+		tile->sad = FLOW_TILE_NO_SAD;
+		tile->sad2 = FLOW_TILE_NO_SAD;
+		tile->score = diff < 0xFFFF ? diff : 0xFFFF;
+
+		if (diff < feature_threshold)
+		{
+			continue;
+		}
+
+		uint32_t dist = 0xFFFFFFFF; // set initial distance to "infinity"
+		uint32_t dist2 = 0xFFFFFFFF; // second best distance, not next to the best one
+		float ambiguity = 0.0f;
+		int8_t sumx = 0;
+		int8_t sumy = 0;
+		int8_t sum2x = 0;
+		int8_t sum2y = 0;
+		int8_t ii, jj;
+
+		/* the search window and the subpixel neighbours below the tile */
+		const uint16_t tile_rows = j + winmax + TILE_SIZE + 1;
+		budget_waited += budget_wait_image(image2, (tile_rows < rows ? tile_rows : rows) * row_size, budget > 0);
+
+		uint8_t *base1 = match1 + j * row_size + i;
+		const uint32_t sum1 = (matcher == MATCHER_ZSAD) ? compute_sum_8x8(base1, row_size) : 0;
+
+		if (pyramid)
+		{
+			/* coarse search on the half resolution images */
+			const uint16_t coarse_row_size = row_size / 2;
+			const uint16_t ci = i / 2 - TILE_SIZE / 4;
+			const uint16_t cj = j / 2 - TILE_SIZE / 4;
+			int8_t coarsex = 0;
+			int8_t coarsey = 0;
+
+			for (jj = -search_size; jj <= search_size; jj++)
+			{
+				for (ii = -search_size; ii <= search_size; ii++)
+				{
+					uint32_t temp_dist = compute_sad_8x8(match_buffers.sad.pyramid1, match_buffers.sad.pyramid2, ci, cj, ci + ii, cj + jj, coarse_row_size);
+					if (temp_dist < dist)
+					{
+						if (!offsets_adjacent(ii, jj, coarsex, coarsey))
+						{
+							dist2 = dist;
+							sum2x = coarsex;
+							sum2y = coarsey;
+						}
+						else if (offsets_adjacent(ii, jj, sum2x, sum2y))
+						{
+							/* the second best belongs to the new minimum */
+							dist2 = 0xFFFFFFFF;
+						}
+
+						coarsex = ii;
+						coarsey = jj;
+						dist = temp_dist;
+					}
+					else if (temp_dist < dist2 && !offsets_adjacent(ii, jj, coarsex, coarsey))
+					{
+						dist2 = temp_dist;
+						sum2x = ii;
+						sum2y = jj;
+					}
+				}
+			}
 
-			uint8_t *base1 = image1 + j * (uint16_t) global_data.param[PARAM_IMAGE_WIDTH] + i;
+			/* refine by one pixel at full resolution, the ambiguity is that of the coarse search */
+			ambiguity = compute_ambiguity(dist, dist2);
+			dist = 0xFFFFFFFF;
 
-			for (jj = winmin; jj <= winmax; jj++)
+			for (jj = 2 * coarsey - 1; jj <= 2 * coarsey + 1; jj++)
 			{
-				uint8_t *base2 = image2 + (j+jj) * (uint16_t) global_data.param[PARAM_IMAGE_WIDTH] + i;
+				uint8_t *base2 = match2 + (j+jj) * row_size + i;
 
-				for (ii = winmin; ii <= winmax; ii++)
+				for (ii = 2 * coarsex - 1; ii <= 2 * coarsex + 1; ii++)
 				{
-//					uint32_t temp_dist = compute_sad_8x8(image1, image2, i, j, i + ii, j + jj, (uint16_t) global_data.param[PARAM_IMAGE_WIDTH]);
-					uint32_t temp_dist = ABSDIFF(base1, base2 + ii);
+					uint32_t temp_dist = compute_match_8x8(base1, base2 + ii, row_size, matcher, sum1);
 					if (temp_dist < dist)
 					{
 						sumx = ii;
@@ -459,14 +2023,82 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 					}
 				}
 			}
+		}
+		else
+		{
+			/* the window is centered on the predicted shift */
+			uint8_t *base2 = match2 + (j+predy) * row_size + i + predx;
+			tile_match_t match;
+
+			if (search_kernel != NULL)
+			{
+				search_kernel(base1, base2, sum1, ambiguity_check, &match);
+			}
+			else if (early_termination)
+			{
+				search_spiral_any(base1, base2, row_size, tile_search_size, matcher, sum1, ambiguity_check, &match);
+			}
+			else
+			{
+				search_window_any(base1, base2, row_size, tile_search_size, matcher, sum1, &match);
+			}
+
+			dist = match.dist;
+			dist2 = match.dist2;
+			sumx = predx + match.x;
+			sumy = predy + match.y;
+		}
+
+		if (!pyramid)
+		{
+			ambiguity = compute_ambiguity(dist, dist2);
+		}
+
+		tile->flow_x = 8 * sumx;
+		tile->flow_y = 8 * sumy;
+		tile->sad = dist < FLOW_TILE_NO_SAD ? dist : FLOW_TILE_NO_SAD;
+		tile->sad2 = dist2 < FLOW_TILE_NO_SAD ? dist2 : FLOW_TILE_NO_SAD;
+
+		/* acceptance SAD distance threshhold, tiles which match at two places are aliased */
+		if (dist < value_threshold && !(ambiguity_check && ambiguity > ambiguity_threshold))
+		{
+			ambiguity_sum += ambiguity;
+
+			meanflowx += (float) sumx;
+			meanflowy += (float) sumy;
+
+			float subdirx = 0.0f;
+			float subdiry = 0.0f;
+
+			if (parabolic)
+			{
+				/* fit the SADs of the neighbouring integer shifts */
+				uint8_t *base2 = match2 + (j+sumy) * row_size + i + sumx;
 
-			/* acceptance SAD distance threshhold */
-			if (dist < global_data.param[PARAM_BOTTOM_FLOW_VALUE_THRESHOLD])
+				subdirx = compute_parabola(compute_match_8x8(base1, base2 - 1, row_size, matcher, sum1), dist,
+						compute_match_8x8(base1, base2 + 1, row_size, matcher, sum1));
+				subdiry = compute_parabola(compute_match_8x8(base1, base2 - row_size, row_size, matcher, sum1), dist,
+						compute_match_8x8(base1, base2 + row_size, row_size, matcher, sum1));
+			}
+			else
 			{
-				meanflowx += (float) sumx;
-				meanflowy += (float) sumy;
+				if (subpixel_cache)
+				{
+					/* interpolate image2 once for all tiles */
+					if (!subpixel_planes_valid)
+					{
+						budget_waited += budget_wait_image(image2, row_size * rows, budget > 0);
+						compute_subpixel_planes(image2, row_size, rows);
+						subpixel_planes_valid = true;
+					}
+
+					compute_subpixel_cached(image1, i, j, i + sumx, j + sumy, acc, row_size);
+				}
+				else
+				{
+					compute_subpixel(image1, image2, i, j, i + sumx, j + sumy, acc, row_size);
+				}
 
-				compute_subpixel(image1, image2, i, j, i + sumx, j + sumy, acc, (uint16_t) global_data.param[PARAM_IMAGE_WIDTH]);
 				uint32_t mindist = dist; // best SAD until now
 				uint8_t mindir = 8; // direction 8 for no direction
 				for(uint8_t k = 0; k < 8; k++)
@@ -478,26 +2110,41 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 						mindir = k;
 					}
 				}
-				dirsx[meancount] = sumx;
-				dirsy[meancount] = sumy;
-				subdirs[meancount] = mindir;
-				meancount++;
-
-				/* feed histogram filter*/
-				uint8_t hist_index_x = 2*sumx + (winmax-winmin+1);
-				if (subdirs[i] == 0 || subdirs[i] == 1 || subdirs[i] == 7) hist_index_x += 1;
-				if (subdirs[i] == 3 || subdirs[i] == 4 || subdirs[i] == 5) hist_index_x += -1;
-				uint8_t hist_index_y = 2*sumy + (winmax-winmin+1);
-				if (subdirs[i] == 5 || subdirs[i] == 6 || subdirs[i] == 7) hist_index_y += -1;
-				if (subdirs[i] == 1 || subdirs[i] == 2 || subdirs[i] == 3) hist_index_y += 1;
-
-				histx[hist_index_x]++;
-				histy[hist_index_y]++;
 
+				/* half pixel shift of the best direction */
+				if (mindir == 0 || mindir == 1 || mindir == 7) subdirx = 0.5f;
+				if (mindir == 3 || mindir == 4 || mindir == 5) subdirx = -0.5f;
+				if (mindir == 5 || mindir == 6 || mindir == 7) subdiry = -0.5f;
+				if (mindir == 1 || mindir == 2 || mindir == 3) subdiry = 0.5f;
 			}
+
+			tile_px[meancount] = i + TILE_SIZE / 2 - row_size / 2.0f;
+			tile_py[meancount] = j + TILE_SIZE / 2 - rows / 2.0f;
+			tile_vx[meancount] = sumx + subdirx;
+			tile_vy[meancount] = sumy + subdiry;
+			meancount++;
+
+			tile->flow_x = roundf(8.0f * tile_vx[meancount - 1]);
+			tile->flow_y = roundf(8.0f * tile_vy[meancount - 1]);
+			tile->sad |= FLOW_TILE_ACCEPTED;
+
+			/* feed histogram filter, subpixel shifts are rounded to half pixels */
+			uint8_t hist_index_x = 2*sumx + (winmax-winmin+1);
+			if (subdirx > 0.25f) hist_index_x += 1;
+			if (subdirx < -0.25f) hist_index_x += -1;
+			uint8_t hist_index_y = 2*sumy + (winmax-winmin+1);
+			if (subdiry < -0.25f) hist_index_y += -1;
+			if (subdiry > 0.25f) hist_index_y += 1;
+
+			histx[hist_index_x]++;
+			histy[hist_index_y]++;
+
 		}
 	}
 
+	/* image2 is image1 of the next call, return only once it is complete */
+	dcmi_wait_image(image2, row_size * rows);
+
 	/* create flow image if needed (image1 is not needed anymore)
 	 * -> can be used for debugging purpose
 	 */
@@ -545,10 +2192,29 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 			}
 		}
 
+		/* robust motion model of all tile vectors */
+		float model[4];
+		inliers = meancount;
+
+		if (model_fit)
+		{
+			inliers = compute_flow_model(tile_px, tile_py, tile_vx, tile_vy, meancount, model);
+		}
+
 		/* check if there is a peak value in histogram */
-		if (1) //(histx[maxpositionx] > meancount / 6 && histy[maxpositiony] > meancount / 6)
+		if (inliers > 10) //(histx[maxpositionx] > meancount / 6 && histy[maxpositiony] > meancount / 6)
 		{
-			if (FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_HIST_FILTER]))
+			if (model_fit)
+			{
+				/* translation at the image center */
+				histflowx = model[0];
+				histflowy = model[1];
+
+				flow_model.divergence = model[2];
+				flow_model.rotation = model[3];
+				flow_model.inliers = inliers;
+			}
+			else if (FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_HIST_FILTER]))
 			{
 
 				/* use histogram filter peek value */
@@ -642,16 +2308,10 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 
 				for (uint8_t h = 0; h < meancount; h++)
 				{
-					float subdirx = 0.0f;
-					if (subdirs[h] == 0 || subdirs[h] == 1 || subdirs[h] == 7) subdirx = 0.5f;
-					if (subdirs[h] == 3 || subdirs[h] == 4 || subdirs[h] == 5) subdirx = -0.5f;
-					histflowx += (float)dirsx[h] + subdirx;
+					histflowx += tile_vx[h];
 					meancount_x++;
 
-					float subdiry = 0.0f;
-					if (subdirs[h] == 5 || subdirs[h] == 6 || subdirs[h] == 7) subdiry = -0.5f;
-					if (subdirs[h] == 1 || subdirs[h] == 2 || subdirs[h] == 3) subdiry = 0.5f;
-					histflowy += (float)dirsy[h] + subdiry;
+					histflowy += tile_vy[h];
 					meancount_y++;
 				}
 
@@ -661,13 +2321,10 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 			}
 
 			/* compensate rotation */
-			/* calculate focal_length in pixel */
-			const float focal_length_px = (global_data.param[PARAM_FOCAL_LENGTH_MM]) / (4.0f * 6.0f) * 1000.0f; //original focal lenght: 12mm pixelsize: 6um, binning 4 enabled
-
 			/*
 			 * gyro compensation
 			 * the compensated value is clamped to
-			 * the maximum measurable flow value (param BFLOW_MAX_PIX) +0.5
+			 * the maximum measurable flow value (param BFLOW_MAX_PIX, extended by BFLOW_PYRAMID or BFLOW_GYRO_PRD) +0.5
 			 * (sub pixel flow can add half pixel to the value)
 			 *
 			 * -y_rate gives x flow
@@ -682,10 +2339,10 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 					float comp_x = histflowx + y_rate_pixel;
 
                     /* clamp value to maximum search window size plus half pixel from subpixel search */
-                    if (comp_x < (-SEARCH_SIZE - 0.5f))
-                    	*pixel_flow_x = (-SEARCH_SIZE - 0.5f);
-                    else if (comp_x > (SEARCH_SIZE + 0.5f))
-                    	*pixel_flow_x = (SEARCH_SIZE + 0.5f);
+                    if (comp_x < (winmin - 0.5f))
+                    	*pixel_flow_x = (winmin - 0.5f);
+                    else if (comp_x > (winmax + 0.5f))
+                    	*pixel_flow_x = (winmax + 0.5f);
                     else
                     	*pixel_flow_x = comp_x;
 				}
@@ -701,10 +2358,10 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 					float comp_y = histflowy - x_rate_pixel;
 
 					/* clamp value to maximum search window size plus/minus half pixel from subpixel search */
-					if (comp_y < (-SEARCH_SIZE - 0.5f))
-						*pixel_flow_y = (-SEARCH_SIZE - 0.5f);
-					else if (comp_y > (SEARCH_SIZE + 0.5f))
-						*pixel_flow_y = (SEARCH_SIZE + 0.5f);
+					if (comp_y < (winmin - 0.5f))
+						*pixel_flow_y = (winmin - 0.5f);
+					else if (comp_y > (winmax + 0.5f))
+						*pixel_flow_y = (winmax + 0.5f);
 					else
 						*pixel_flow_y = comp_y;
 				}
@@ -743,7 +2400,21 @@ uint8_t compute_flow(uint8_t *image1, uint8_t *image2, float x_rate, float y_rat
 	}
 
 	/* calc quality */
-	uint8_t qual = (uint8_t)(meancount * 255 / (NUM_BLOCKS*NUM_BLOCKS));
+	uint8_t qual = (uint8_t)(inliers * 255 / (NUM_BLOCKS*NUM_BLOCKS));
+
+	/* distinct matches keep the full quality, it drops as the tiles become ambiguous */
+	if (ambiguity_check)
+	{
+		float distinctness = 2.0f * (1.0f - ambiguity_sum / meancount);
+		if (distinctness < 0.0f)
+		{
+			qual = 0;
+		}
+		else if (distinctness < 1.0f)
+		{
+			qual = (uint8_t)(qual * distinctness);
+		}
+	}
 
 	return qual;
 }
@@ -42,6 +42,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "stm32f4xx_conf.h"
 #include "stm32f4xx.h"
@@ -78,26 +79,33 @@
 #define SCB_CPACR (*((uint32_t*) (((0xE000E000UL) + 0x0D00UL) + 0x088)))
 #endif
 
+/* cycle counter of the data watchpoint and trace unit */
+#define DWT_CTRL	(*((volatile uint32_t*) 0xE0001000UL))
+#define DWT_CYCCNT	(*((volatile uint32_t*) 0xE0001004UL))
+#define DWT_CTRL_CYCCNTENA	(1UL << 0)
+#define DEMCR_TRCENA	(1UL << 24)
+
 
 
 /* prototypes */
 void delay(unsigned msec);
 void buffer_reset(void);
+void send_flow_field(uint8_t qual);
 
 __ALIGN_BEGIN USB_OTG_CORE_HANDLE  USB_OTG_dev __ALIGN_END;
 
-/* fast image buffers for calculations */
+/* fast image buffers for calculations, the images are copied here if the DCMI buffers can not be lent */
 uint8_t image_buffer_8bit_1[FULL_IMAGE_SIZE] __attribute__((section(".ccm")));
 uint8_t image_buffer_8bit_2[FULL_IMAGE_SIZE] __attribute__((section(".ccm")));
 uint8_t buffer_reset_needed;
 
 /* boot time in milliseconds ticks */
 volatile uint32_t boot_time_ms = 0;
-/* boot time in 10 microseconds ticks */
-volatile uint32_t boot_time10_us = 0;
+/* overflows of the 32 bit microsecond counter, the upper half of the boot time in microseconds */
+volatile uint32_t boot_time_us_overflows = 0;
 
 /* timer constants */
-#define NTIMERS         	9
+#define NTIMERS         	10
 #define TIMER_CIN       	0
 #define TIMER_LED       	1
 #define TIMER_DELAY     	2
@@ -107,15 +115,17 @@ volatile uint32_t boot_time10_us = 0;
 #define TIMER_PARAMS		6
 #define TIMER_IMAGE			7
 #define TIMER_LPOS		8
-#define MS_TIMER_COUNT		100 /* steps in 10 microseconds ticks */
+#define TIMER_EXPOSURE		9
+#define MS_TIMER_COUNT		1000 /* steps in microseconds ticks */
 #define LED_TIMER_COUNT		500 /* steps in milliseconds ticks */
 #define SONAR_TIMER_COUNT 	100	/* steps in milliseconds ticks */
 #define SYSTEM_STATE_COUNT	1000/* steps in milliseconds ticks */
 #define PARAMS_COUNT		100	/* steps in milliseconds ticks */
 #define LPOS_TIMER_COUNT 	100	/* steps in milliseconds ticks */
+#define EXPOSURE_TIMER_COUNT	100	/* steps in milliseconds ticks */
+#define FLOW_FIELD_DATA_TYPE	128	/* data stream type of the tile field, not used by MAVLINK_DATA_STREAM_TYPE */
 
 static volatile unsigned timer[NTIMERS];
-static volatile unsigned timer_ms = MS_TIMER_COUNT;
 
 /* timer/system booleans */
 bool send_system_state_now = true;
@@ -123,6 +133,7 @@ bool receive_now = true;
 bool send_params_now = true;
 bool send_image_now = true;
 bool send_lpos_now = true;
+bool update_exposure_now = true;
 
 /* local position estimate without orientation, useful for unit testing w/o FMU */
 static struct lpos_t {
@@ -191,37 +202,117 @@ void timer_update_ms(void)
 		send_lpos_now = true;
 		timer[TIMER_LPOS] = LPOS_TIMER_COUNT;
 	}
+
+	if (timer[TIMER_EXPOSURE] == 0)
+	{
+		update_exposure_now = true;
+		timer[TIMER_EXPOSURE] = EXPOSURE_TIMER_COUNT;
+	}
 }
 
 /**
-  * @brief  Increment boot_time10_us variable and decrement millisecond timer, triggered by timer interrupt
+  * @brief  Extend the microsecond counter on overflow and run the millisecond timers on the compare event, triggered by TIM5 interrupt
   * @param  None
   * @retval None
   */
 void timer_update(void)
 {
-	boot_time10_us++;
-
-	/*  decrements every 10 microseconds*/
-	timer_ms--;
+	if (TIM_GetITStatus(TIM5, TIM_IT_Update) != RESET)
+	{
+		/* count and clear together, get_boot_time_us() may run in an interrupt preempting this one */
+		__disable_irq();
+		boot_time_us_overflows++;
+		TIM_ClearITPendingBit(TIM5, TIM_IT_Update);
+		__enable_irq();
+	}
 
-	if (timer_ms == 0)
+	if (TIM_GetITStatus(TIM5, TIM_IT_CC1) != RESET)
 	{
+		uint32_t compare = TIM_GetCapture1(TIM5) + MS_TIMER_COUNT;
+
+		/* the compare only matches on equality, skip ahead if this interrupt was held off for a whole period */
+		if ((int32_t)(compare - TIM_GetCounter(TIM5)) <= 0)
+			compare = TIM_GetCounter(TIM5) + MS_TIMER_COUNT;
+
+		TIM_ClearITPendingBit(TIM5, TIM_IT_CC1);
+		TIM_SetCompare1(TIM5, compare);
 		timer_update_ms();
-		timer_ms = MS_TIMER_COUNT;
 	}
-
 }
 
+/**
+  * @brief  Start the free running microsecond counter on TIM5, its compare channel 1 triggers the millisecond timers
+  * @param  None
+  * @retval None
+  */
+static void timer_init(void)
+{
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+
+	/* TIM5 clock enable */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5, ENABLE);
+
+	/* time base configuration: APB1 runs at HCLK / 4, its timers at HCLK / 2, count microseconds over the full 32 bit */
+	TIM_TimeBaseStructure.TIM_Period = 0xFFFFFFFF;
+	TIM_TimeBaseStructure.TIM_Prescaler = SystemCoreClock / 2 / 1000000 - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = 0;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+
+	TIM_TimeBaseInit(TIM5, &TIM_TimeBaseStructure);
+
+	/* compare channel 1 without output, moved on by one millisecond on every match */
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+	TIM_OCInitStructure.TIM_Pulse = MS_TIMER_COUNT;
+
+	TIM_OC1Init(TIM5, &TIM_OCInitStructure);
+
+	TIM_OC1PreloadConfig(TIM5, TIM_OCPreload_Disable);
+
+	/* the prescaler reload of the time base init raised the update flag */
+	TIM_ClearITPendingBit(TIM5, TIM_IT_Update | TIM_IT_CC1);
+	TIM_ITConfig(TIM5, TIM_IT_Update | TIM_IT_CC1, ENABLE);
+
+	/* lowest priority, as the SysTick interrupt it replaces */
+	NVIC_SetPriority(TIM5_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+	NVIC_EnableIRQ(TIM5_IRQn);
+
+	/* TIM5 enable counter */
+	TIM_Cmd(TIM5, ENABLE);
+}
 
 uint32_t get_boot_time_ms(void)
 {
 	return boot_time_ms;
 }
 
-uint32_t get_boot_time_us(void)
+uint64_t get_boot_time_us(void)
+{
+	uint32_t high;
+	uint32_t low;
+	uint32_t overflow_pending;
+
+	/* retry if the overflow interrupt ran in between */
+	do
+	{
+		high = boot_time_us_overflows;
+		low = TIM_GetCounter(TIM5);
+		overflow_pending = TIM_GetITStatus(TIM5, TIM_IT_Update);
+	}
+	while (high != boot_time_us_overflows);
+
+	/* the counter wrapped but the interrupt counting it has not run yet, e.g. when called from a higher priority interrupt */
+	if (overflow_pending && low < 0x80000000)
+		high++;
+
+	return ((uint64_t)high << 32) | low;
+}
+
+uint32_t get_cycle_count(void)
 {
-	return boot_time10_us*10;// *10 to return microseconds
+	return DWT_CYCCNT;
 }
 
 void delay(unsigned msec)
@@ -234,6 +325,39 @@ void buffer_reset(void) {
 	buffer_reset_needed = 1;
 }
 
+/**
+  * @brief  Sends the tile field of the last flow calculation over USB.
+  *
+  * The handshake announces record size, tile count and flow quality,
+  * the flow_tile_t records follow packed into ENCAPSULATED_DATA packets.
+  */
+void send_flow_field(uint8_t qual)
+{
+	uint16_t count;
+	const flow_tile_t *tiles = get_flow_field(&count);
+	const uint16_t size = count * sizeof(flow_tile_t);
+	const uint16_t packets = (size + MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN - 1) / MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN;
+	uint8_t data[MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN];
+
+	mavlink_msg_data_transmission_handshake_send(MAVLINK_COMM_2, FLOW_FIELD_DATA_TYPE, size,
+			sizeof(flow_tile_t), count, packets, MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN, qual);
+
+	for (uint16_t packet = 0; packet < packets; packet++)
+	{
+		uint16_t offset = packet * MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN;
+		uint16_t length = size - offset;
+
+		if (length > MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN)
+		{
+			length = MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN;
+		}
+
+		memset(data, 0, sizeof(data));
+		memcpy(data, (const uint8_t *) tiles + offset, length);
+		mavlink_msg_encapsulated_data_send(MAVLINK_COMM_2, packet, data);
+	}
+}
+
 /**
   * @brief  Main function.
   */
@@ -264,13 +388,13 @@ int main(void)
 	/* enable FPU on Cortex-M4F core */
 	SCB_CPACR |= ((3UL << 10 * 2) | (3UL << 11 * 2)); /* set CP10 Full Access and set CP11 Full Access */
 
+	/* enable cycle counter for the flow compute budget */
+	CoreDebug->DEMCR |= DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
 	/* init clock */
-	if (SysTick_Config(SystemCoreClock / 100000))/*set timer to trigger interrupt every 10 microsecond */
-	{
-		/* capture clock error */
-		LEDOn(LED_ERR);
-		while (1);
-	}
+	timer_init();
 
 	/* init usb */
 	USBD_Init(	&USB_OTG_dev,
@@ -333,6 +457,21 @@ int main(void)
 	int valid_frame_count = 0;
 	int pixel_flow_count = 0;
 
+	/* keyframe variables */
+	bool keyframe_hold = false; // previous_image is kept as keyframe for the next frame
+	float keyframe_flow_x = 0.0f; // flow of the last frame relative to the keyframe
+	float keyframe_flow_y = 0.0f;
+
+	/* frame rate variables */
+	uint32_t rate_frame_count = 0;
+	uint32_t rate_dropped_tiles = 0;
+	uint32_t rate_skipped_frames = 0;
+	uint32_t rate_time = 0;
+
+	/* time to contact variables */
+	float divergence_rate = 0.0f;
+	float time_to_contact = 0.0f;
+
 	static float accumulated_flow_x = 0;
 	static float accumulated_flow_y = 0;
 	static float accumulated_gyro_x = 0;
@@ -341,6 +480,9 @@ int main(void)
 	static uint16_t accumulated_framecount = 0;
 	static uint16_t accumulated_quality = 0;
 	static uint32_t integration_timespan = 0;
+	static float accumulated_rotation = 0;
+	static float accumulated_divergence = 0;
+	static uint32_t model_timespan = 0;
 	static uint32_t lasttime = 0;
 	uint32_t time_since_last_sonar_update= 0;
 
@@ -360,6 +502,13 @@ int main(void)
 				image_buffer_8bit_1[i] = 0;
 				image_buffer_8bit_2[i] = 0;
 			}
+			flow_invalidate_image(image_buffer_8bit_1);
+			flow_invalidate_image(image_buffer_8bit_2);
+
+			/* lent DCMI buffers were taken back by dma_reconfigure */
+			current_image = image_buffer_8bit_1;
+			previous_image = image_buffer_8bit_2;
+			keyframe_hold = false;
 			delay(500);
 			continue;
 		}
@@ -425,11 +574,67 @@ int main(void)
 		/* compute optical flow */
 		if (FLOAT_EQ_INT(global_data.param[PARAM_SENSOR_POSITION], BOTTOM))
 		{
-			/* copy recent image to faster ram */
-			dma_copy_image_buffers(&current_image, &previous_image, image_size, 1);
+			if (FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME]))
+			{
+				/* the swap in dma_copy_image_buffers undoes this one, the new image replaces the last one and the keyframe stays */
+				if (keyframe_hold)
+				{
+					uint8_t *tmp_image = current_image;
+					current_image = previous_image;
+					previous_image = tmp_image;
+				}
 
-			/* compute optical flow */
-			qual = compute_flow(previous_image, current_image, x_rate, y_rate, z_rate, &pixel_flow_x, &pixel_flow_y);
+				/* copy recent image to faster ram */
+				dma_copy_image_buffers(&current_image, &previous_image, image_size, 1);
+
+				/* flow since the keyframe, uncompensated since the gyro rates only hold for the last frame */
+				float flow_x, flow_y;
+				qual = compute_flow(previous_image, current_image, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+				if (qual > 0)
+				{
+					/* flow of this frame */
+					pixel_flow_x = flow_x - keyframe_flow_x;
+					pixel_flow_y = flow_y - keyframe_flow_y;
+					compensate_flow_gyro(x_rate, y_rate, &pixel_flow_x, &pixel_flow_y);
+
+					keyframe_flow_x = flow_x;
+					keyframe_flow_y = flow_y;
+				}
+				else
+				{
+					pixel_flow_x = 0.0f;
+					pixel_flow_y = 0.0f;
+				}
+
+				/* this image becomes the next keyframe if it moved too far or matched too badly */
+				keyframe_hold = qual >= global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME_QUALITY] &&
+						fabsf(flow_x) < global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT] &&
+						fabsf(flow_y) < global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT];
+
+				if (!keyframe_hold)
+				{
+					keyframe_flow_x = 0.0f;
+					keyframe_flow_y = 0.0f;
+				}
+			}
+			else
+			{
+				/* copy recent image to faster ram */
+				dma_copy_image_buffers(&current_image, &previous_image, image_size, 1);
+
+				/* compute optical flow */
+				qual = compute_flow(previous_image, current_image, x_rate, y_rate, z_rate, &pixel_flow_x, &pixel_flow_y);
+				keyframe_hold = false;
+			}
+
+			/* rotation and scale change of the image from the motion model, it is relative to the keyframe in keyframe mode */
+			if (get_flow_model()->inliers > 0 && !FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME]))
+			{
+				accumulated_rotation += get_flow_model()->rotation;
+				accumulated_divergence += get_flow_model()->divergence;
+				model_timespan += get_time_between_images();
+			}
 
 			/*
 			 * real point P (X,Y,Z), image plane projection p (x,y,z), focal-length f, distance-to-scene Z
@@ -454,7 +659,7 @@ int main(void)
 					velocity_y_sum += new_velocity_y;
 					valid_frame_count++;
 
-					uint32_t deltatime = (get_boot_time_us() - lasttime);
+					uint32_t deltatime = (get_image_time() - lasttime);
 					integration_timespan += deltatime;
 					accumulated_flow_x += pixel_flow_y  / focal_length_px * 1.0f; //rad axis swapped to align x flow around y axis
 					accumulated_flow_y += pixel_flow_x  / focal_length_px * -1.0f;//rad
@@ -483,16 +688,49 @@ int main(void)
 				velocity_x_lp = (1.0f - global_data.param[PARAM_BOTTOM_FLOW_WEIGHT_NEW]) * velocity_x_lp;
 				velocity_y_lp = (1.0f - global_data.param[PARAM_BOTTOM_FLOW_WEIGHT_NEW]) * velocity_y_lp;
 			}
-			//update lasttime
-			lasttime = get_boot_time_us();
+			//update lasttime, the middle of the exposure of this frame
+			lasttime = get_image_time();
 
 			pixel_flow_x_sum += pixel_flow_x;
 			pixel_flow_y_sum += pixel_flow_y;
 			pixel_flow_count++;
 
 		}
+		else
+		{
+			/* copy recent image to faster ram */
+			dma_copy_image_buffers(&current_image, &previous_image, image_size, 1);
+
+			/* compute optical flow, the motion model is always fitted for other positions */
+			qual = compute_flow(previous_image, current_image, x_rate, y_rate, z_rate, &pixel_flow_x, &pixel_flow_y);
+
+			/*
+			 * approaching a surface at distance Z with speed V scales the image by Z / (Z - V dt),
+			 * so the relative expansion rate is V / Z and its inverse the time to contact
+			 */
+			divergence_rate = 0.0f;
+			time_to_contact = 0.0f;
+
+			if (get_flow_model()->inliers > 0 && !FLOAT_EQ_FLOAT(get_flow_model()->divergence, 0.0f))
+			{
+				divergence_rate = get_flow_model()->divergence / (get_time_between_images() / 1000000.0f);
+				time_to_contact = 1.0f / divergence_rate;
+			}
+		}
+
+		/* transmit the match results of all tiles */
+		if (FLOAT_AS_BOOL(global_data.param[PARAM_USB_SEND_FIELD]))
+		{
+			send_flow_field(qual);
+		}
 
 		counter++;
+		rate_frame_count++;
+		rate_dropped_tiles += get_flow_budget_dropped();
+
+		/* serial output every BFLOW_THROTT frames, 0 sends every frame */
+		const uint32_t serial_throttle = global_data.param[PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR] >= 1.0f ?
+				(uint32_t)global_data.param[PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR] : 1;
 
 		if (FLOAT_EQ_INT(global_data.param[PARAM_SENSOR_POSITION], BOTTOM))
 		{
@@ -534,7 +772,7 @@ int main(void)
                         PROBE_3(true);
 
             //serial mavlink  + usb mavlink output throttled
-			if (counter % (uint32_t)global_data.param[PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR] == 0)//throttling factor
+			if (counter % serial_throttle == 0)//throttling factor
 			{
 
 				float flow_comp_m_x = 0.0f;
@@ -613,6 +851,24 @@ int main(void)
 					mavlink_msg_debug_vect_send(MAVLINK_COMM_2, "GYRO", get_boot_time_us(), x_rate, y_rate, z_rate);
 				}
 
+				/* image rotation rate around the optical axis (rad/s), divergence (1/s) and inliers of the motion model */
+				if (FLOAT_AS_BOOL(global_data.param[PARAM_BOTTOM_FLOW_MODEL]) && model_timespan > 0)
+				{
+					float rotation_rate = accumulated_rotation / (model_timespan / 1000000.0f);
+					float model_divergence_rate = accumulated_divergence / (model_timespan / 1000000.0f);
+
+					mavlink_msg_debug_vect_send(MAVLINK_COMM_0, "FLOW_MODEL", get_boot_time_us(), rotation_rate, model_divergence_rate, get_flow_model()->inliers);
+
+					if (FLOAT_AS_BOOL(global_data.param[PARAM_USB_SEND_FLOW]))
+					{
+						mavlink_msg_debug_vect_send(MAVLINK_COMM_2, "FLOW_MODEL", get_boot_time_us(), rotation_rate, model_divergence_rate, get_flow_model()->inliers);
+					}
+				}
+
+				accumulated_rotation = 0;
+				accumulated_divergence = 0;
+				model_timespan = 0;
+
 				integration_timespan = 0;
 				accumulated_flow_x = 0;
 				accumulated_flow_y = 0;
@@ -630,6 +886,29 @@ int main(void)
 				pixel_flow_count = 0;
 			}
 		}
+		else
+		{
+			/*
+			 * send time to contact, negative if the scene is receding and 0 if unknown,
+			 * throttled like the bottom flow on the serial link which can not carry it every frame
+			 */
+			if (counter % serial_throttle == 0)
+			{
+				mavlink_msg_debug_vect_send(MAVLINK_COMM_0, "TTC", get_boot_time_us(), time_to_contact, divergence_rate, qual);
+			}
+
+			if (FLOAT_AS_BOOL(global_data.param[PARAM_USB_SEND_FLOW]))
+			{
+				mavlink_msg_debug_vect_send(MAVLINK_COMM_2, "TTC", get_boot_time_us(), time_to_contact, divergence_rate, qual);
+			}
+
+			uavcan_define_export(ttc_data, ttc_data_t, ccm);
+			uavcan_timestamp_export(ttc_data);
+			uavcan_assign(ttc_data.time_to_contact, time_to_contact);
+			uavcan_assign(ttc_data.divergence, divergence_rate);
+			uavcan_assign(ttc_data.qual, qual);
+			uavcan_publish(ttc, 1, ttc_data);
+		}
 
 		/* forward flow from other sensors */
 		if (counter % 2)
@@ -645,6 +924,26 @@ int main(void)
 			{
 				communication_system_state_send();
 			}
+
+			/* achieved frame rate, frames lost while computing and tiles dropped by the budget */
+			uint32_t rate_now = get_boot_time_us();
+			if (rate_time > 0 && rate_now > rate_time)
+			{
+				float frame_rate = rate_frame_count * 1000000.0f / (rate_now - rate_time);
+				uint32_t skipped_frames = get_skipped_frame_counter() - rate_skipped_frames;
+
+				mavlink_msg_debug_vect_send(MAVLINK_COMM_0, "FLOW_RATE", rate_now, frame_rate, skipped_frames, rate_dropped_tiles);
+
+				if (FLOAT_AS_BOOL(global_data.param[PARAM_USB_SEND_FLOW]))
+				{
+					mavlink_msg_debug_vect_send(MAVLINK_COMM_2, "FLOW_RATE", rate_now, frame_rate, skipped_frames, rate_dropped_tiles);
+				}
+			}
+
+			rate_time = rate_now;
+			rate_frame_count = 0;
+			rate_dropped_tiles = 0;
+			rate_skipped_frames = get_skipped_frame_counter();
 			send_system_state_now = false;
 		}
 
@@ -670,11 +969,21 @@ int main(void)
 		{
 			if (FLOAT_AS_BOOL(global_data.param[PARAM_SYSTEM_SEND_LPOS]))
 			{
-				mavlink_msg_local_position_ned_send(MAVLINK_COMM_2, timer_ms, lpos.x, lpos.y, lpos.z, lpos.vx, lpos.vy, lpos.vz);
+				mavlink_msg_local_position_ned_send(MAVLINK_COMM_2, get_boot_time_ms(), lpos.x, lpos.y, lpos.z, lpos.vx, lpos.vy, lpos.vz);
 			}
 			send_lpos_now = false;
 		}
 
+		/* exposure of the sensor for the frame time stamps, flow images only */
+		if (update_exposure_now)
+		{
+			if (!FLOAT_AS_BOOL(global_data.param[PARAM_VIDEO_ONLY]))
+			{
+				dcmi_update_exposure();
+			}
+			update_exposure_now = false;
+		}
+
 		/*  transmit raw 8-bit image */
 		if (FLOAT_AS_BOOL(global_data.param[PARAM_USB_SEND_VIDEO])&& send_image_now)
 		{
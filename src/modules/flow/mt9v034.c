@@ -79,7 +79,7 @@ void mt9v034_context_configuration(void)
 	uint16_t new_height_context_b = FULL_IMAGE_COLUMN_SIZE * 4;
 
 	/* blanking settings */
-	uint16_t new_hor_blanking_context_a = 350 + MINIMUM_HORIZONTAL_BLANKING;// 350 is minimum value without distortions
+	uint16_t new_hor_blanking_context_a = HORIZONTAL_BLANKING_A;
 	uint16_t new_ver_blanking_context_a = 10; // this value is the first without image errors (dark lines)
 	uint16_t new_hor_blanking_context_b = MAX_IMAGE_WIDTH - new_width_context_b + MINIMUM_HORIZONTAL_BLANKING;
 	uint16_t new_ver_blanking_context_b = 10;
@@ -221,6 +221,25 @@ void mt9v034_context_configuration(void)
 
 }
 
+/**
+  * @brief  Time the sensor takes per row of context A
+  *
+  * A row lasts the window width plus the horizontal blanking in master clocks,
+  * binning reduces the rows but not their time.
+  */
+float mt9v034_get_row_time_us(void)
+{
+	return (global_data.param[PARAM_IMAGE_WIDTH] * BINNING_COLUMN_A + HORIZONTAL_BLANKING_A) / (float) MASTER_CLOCK_MHZ;
+}
+
+/**
+  * @brief  Exposure time the AEC chose, in rows
+  */
+uint16_t mt9v034_get_exposure_rows(void)
+{
+	return mt9v034_ReadReg16(MTV_AEC_EXPOSURE_REG);
+}
+
 /**
   * @brief  Changes sensor context based on settings
   */
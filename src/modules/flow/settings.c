@@ -155,6 +155,10 @@ void global_data_reset_param_defaults(void){
 	strcpy(global_data.param_name[PARAM_USB_SEND_DEBUG], "USB_SEND_DEBUG");
 	global_data.param_access[PARAM_USB_SEND_DEBUG] = READ_WRITE;
 
+	global_data.param[PARAM_USB_SEND_FIELD] = 0; // send the match results of all tiles over USB
+	strcpy(global_data.param_name[PARAM_USB_SEND_FIELD], "USB_SEND_FIELD");
+	global_data.param_access[PARAM_USB_SEND_FIELD] = READ_WRITE;
+
 	global_data.param[PARAM_VIDEO_ONLY] = 0;
 	strcpy(global_data.param_name[PARAM_VIDEO_ONLY], "VIDEO_ONLY");
 	global_data.param_access[PARAM_VIDEO_ONLY] = READ_WRITE;
@@ -199,6 +203,66 @@ void global_data_reset_param_defaults(void){
 	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR], "BFLOW_THROTT");
 	global_data.param_access[PARAM_BOTTOM_FLOW_SERIAL_THROTTLE_FACTOR] = READ_WRITE;
 
+	global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 0; // coarse-to-fine search, doubles the measurable flow
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_PYRAMID], "BFLOW_PYRAMID");
+	global_data.param_access[PARAM_BOTTOM_FLOW_PYRAMID] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_GYRO_PREDICTION] = 0; // center the search window on the gyro predicted flow
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_GYRO_PREDICTION], "BFLOW_GYRO_PRD");
+	global_data.param_access[PARAM_BOTTOM_FLOW_GYRO_PREDICTION] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = 1; // abort SAD once worse than the best match, same result
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_EARLY_TERMINATION], "BFLOW_EARLY_TRM");
+	global_data.param_access[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_TILE_SELECTION] = 0; // match the best textured tiles instead of a fixed grid
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_TILE_SELECTION], "BFLOW_TILE_SEL");
+	global_data.param_access[PARAM_BOTTOM_FLOW_TILE_SELECTION] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE] = 0; // interpolate the half pixel planes once per frame
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE], "BFLOW_HALF_PEL");
+	global_data.param_access[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 0; // continuous subpixel flow from a parabola fit of the SADs
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_PARABOLIC], "BFLOW_PARABOLA");
+	global_data.param_access[PARAM_BOTTOM_FLOW_PARABOLIC] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_MODEL] = 0; // fit translation, rotation and scale with RANSAC
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_MODEL], "BFLOW_MODEL");
+	global_data.param_access[PARAM_BOTTOM_FLOW_MODEL] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_SAD; // block matching cost, census and ZSAD are robust to exposure changes
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_MATCHER], "BFLOW_MATCHER");
+	global_data.param_access[PARAM_BOTTOM_FLOW_MATCHER] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME] = 0; // match against a keyframe instead of the previous image
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_KEYFRAME], "BFLOW_KEYFRAME");
+	global_data.param_access[PARAM_BOTTOM_FLOW_KEYFRAME] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT] = 2.0f; // new keyframe when the image moved further in pixels
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT], "BFLOW_KF_SHIFT");
+	global_data.param_access[PARAM_BOTTOM_FLOW_KEYFRAME_SHIFT] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_KEYFRAME_QUALITY] = 100; // new keyframe when the quality drops below
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_KEYFRAME_QUALITY], "BFLOW_KF_QUAL");
+	global_data.param_access[PARAM_BOTTOM_FLOW_KEYFRAME_QUALITY] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_BUDGET] = 0; // share of the frame interval for the flow, 0 for no limit
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_BUDGET], "BFLOW_BUDGET");
+	global_data.param_access[PARAM_BOTTOM_FLOW_BUDGET] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD] = 0; // frames with a lower mean gradient are not matched, 0 to match all
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD], "BFLOW_G_THLD");
+	global_data.param_access[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD] = 0; // tiles with a higher best to second best SAD ratio are rejected (e.g. 0.9), 0 to accept all
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD], "BFLOW_A_THLD");
+	global_data.param_access[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD] = READ_WRITE;
+
+	global_data.param[PARAM_BOTTOM_FLOW_PIPELINE] = 0; // match the top tiles while the bottom of the frame still arrives
+	strcpy(global_data.param_name[PARAM_BOTTOM_FLOW_PIPELINE], "BFLOW_PIPELINE");
+	global_data.param_access[PARAM_BOTTOM_FLOW_PIPELINE] = READ_WRITE;
+
 	global_data.param[DEBUG_VARIABLE] = 1;
 	strcpy(global_data.param_name[DEBUG_VARIABLE], "DEBUG");
 	global_data.param_access[DEBUG_VARIABLE] = READ_WRITE;
@@ -222,6 +286,11 @@ void set_sensor_position_settings(uint8_t sensor_position)
 	switch(sensor_position)
 	{
 		case(BOTTOM):
+		case(FRONT):
+		case(TOP):
+		case(BACK):
+		case(RIGHT):
+		case(LEFT):
 			global_data.param[PARAM_IMAGE_WIDTH] = BOTTOM_FLOW_IMAGE_WIDTH;
 			global_data.param[PARAM_IMAGE_HEIGHT] = BOTTOM_FLOW_IMAGE_HEIGHT;
 			break;
@@ -231,6 +300,12 @@ void set_sensor_position_settings(uint8_t sensor_position)
 			return;
 	}
 
+	/* the time to contact of the other positions is computed from the divergence of the motion model */
+	if (sensor_position != BOTTOM)
+	{
+		global_data.param[PARAM_BOTTOM_FLOW_MODEL] = 1;
+	}
+
 	debug_int_message_buffer("Set sensor position:", sensor_position);
 	return;
 }
@@ -57,7 +57,7 @@
 #define SONAR_MAX	3.5f		/** 3.50m sonar maximum distance */
 
 #define atoi(nptr)  strtol((nptr), NULL, 10)
-extern uint32_t get_boot_time_us(void);
+extern uint64_t get_boot_time_us(void);
 
 static char data_buffer[5]; // array for collecting decoded data
 
@@ -135,7 +135,6 @@ void PendSV_Handler(void)
   */
 void SysTick_Handler(void)
 {
-	timer_update();
 }
 
 /******************************************************************************/
@@ -155,4 +154,14 @@ void OTG_FS_IRQHandler(void)
 	USBD_OTG_ISR_Handler (&USB_OTG_dev);
 }
 
+/**
+  * @brief  This function handles TIM5 interrupts, the microsecond clock and the millisecond timers.
+  * @param  None
+  * @retval None
+  */
+void TIM5_IRQHandler(void)
+{
+	timer_update();
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -97,6 +97,7 @@ UavcanNode::UavcanNode(uavcan::ICanDriver &can_driver, uavcan::ISystemClock &sys
 	_time_sync_slave(_node),
 	_flow_pulisher(_node),
 	_range_pulisher(_node),
+	_ttc_pulisher(_node),
 	_reset_timer(_node)
 {
 
@@ -309,6 +310,16 @@ int UavcanNode::publish(legacy_12c_data_t *pdata)
   return PX4_OK;
 
 }
+int UavcanNode::publish(ttc_data_t *pdata)
+{
+  ::threedr::equipment::flow::optical_flow::TimeToContact t;
+  t.time.usec = pdata->time_stamp_utc;
+  t.time_to_contact = pdata->time_to_contact;
+  t.divergence = pdata->divergence;
+  t.qual = pdata->qual;
+  _ttc_pulisher.broadcast(t);
+  return PX4_OK;
+}
 
 
 int UavcanNode::run()
@@ -418,6 +429,18 @@ __EXPORT int uavcannode_publish_range(range_data_t *pdata)
     return inst->publish(pdata);
 }
 
+__EXPORT int uavcannode_publish_ttc(ttc_data_t *pdata)
+{
+
+  UavcanNode *const inst = UavcanNode::instance();
+
+    if (!inst) {
+            PX4_ERR( "application not running");
+            return 1;
+    }
+    return inst->publish(pdata);
+}
+
 __EXPORT int uavcannode_run()
 {
   UavcanNode *const inst = UavcanNode::instance();
@@ -39,6 +39,7 @@
 #include <uavcan/protocol/file/BeginFirmwareUpdate.hpp>
 #include <uavcan/equipment/range_sensor/Measurement.hpp>
 #include <threedr/equipment/flow/optical_flow/LegacyRawSample.hpp>
+#include <threedr/equipment/flow/optical_flow/TimeToContact.hpp>
 #include <uavcan/node/timer.hpp>
 
 #include "uavcan_if.h"
@@ -106,6 +107,7 @@ public:
         int             run();
         int             publish(legacy_12c_data_t *pdata);
         int             publish(range_data_t *pdata);
+        int             publish(ttc_data_t *pdata);
 
 	/* The bit rate that can be passed back to the bootloader */
 
@@ -131,6 +133,7 @@ private:
         uavcan::GlobalTimeSyncSlave _time_sync_slave;
         uavcan::Publisher<::threedr::equipment::flow::optical_flow::LegacyRawSample> _flow_pulisher;
         uavcan::Publisher<uavcan::equipment::range_sensor::Measurement> _range_pulisher;
+        uavcan::Publisher<::threedr::equipment::flow::optical_flow::TimeToContact> _ttc_pulisher;
 	void cb_beginfirmware_update(const uavcan::ReceivedDataStructure<UavcanNode::BeginFirmwareUpdate::Request> &req,
 	                             uavcan::ServiceResponseDataStructure<UavcanNode::BeginFirmwareUpdate::Response> &rsp);
 
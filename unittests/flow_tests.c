@@ -0,0 +1,808 @@
+/**
+ * UNIT TESTS for flow code
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "no_warnings.h"
+#include "settings.h"
+#include "flow.h"
+#include "dcmi.h"
+
+#define IMG_MAX_SIZE (128 * 128)
+#define IMG_WIDTH ((int) global_data.param[PARAM_IMAGE_WIDTH])
+#define IMG_HEIGHT ((int) global_data.param[PARAM_IMAGE_HEIGHT])
+
+static uint8_t image1[IMG_MAX_SIZE];
+static uint8_t image2[IMG_MAX_SIZE];
+static uint8_t image3[IMG_MAX_SIZE];
+
+/* cycles the fake cycle counter of host_stubs.c advances per read */
+extern uint32_t host_cycle_step;
+
+/* mean gradient get_image_gradient of host_stubs.c reports */
+extern float host_image_gradient;
+
+/* sizes of image2 compute_flow waited for in dcmi_wait_image of host_stubs.c */
+extern uint32_t host_wait_first;
+extern uint32_t host_wait_count;
+extern uint32_t host_wait_last;
+extern uint32_t host_wait_cycles;
+
+/* deterministic noise, independent of the host libc */
+static uint8_t noise(int x, int y)
+{
+	uint32_t h = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u);
+	h ^= h >> 13;
+	h *= 0x5bd1e995;
+	h ^= h >> 15;
+	return (uint8_t)h;
+}
+
+/* blurred noise, neighbouring pixels are correlated like in real ground images */
+static uint8_t texture(int x, int y)
+{
+	unsigned sum = 0;
+
+	for (int v = -1; v <= 1; v++) {
+		for (int u = -1; u <= 1; u++) {
+			sum += noise(x + u, y + v);
+		}
+	}
+
+	return (uint8_t)(sum / 9);
+}
+
+/* the scene moved by (dx, dy) pixels */
+static void make_frame(uint8_t *image, int dx, int dy)
+{
+	for (int y = 0; y < IMG_HEIGHT; y++) {
+		for (int x = 0; x < IMG_WIDTH; x++) {
+			image[y * IMG_WIDTH + x] = texture(x - dx, y - dy);
+		}
+	}
+}
+
+/* image2 shows the scene of image1 moved by (dx, dy) pixels */
+static void make_images(int dx, int dy)
+{
+	make_frame(image1, 0, 0);
+	make_frame(image2, dx, dy);
+}
+
+/* sensor noise, so matches are not perfect */
+static void add_frame_noise(uint8_t *image, int seed)
+{
+	for (int k = 0; k < IMG_WIDTH * IMG_HEIGHT; k++) {
+		int value = image[k] + noise(k, seed) % 32 - 16;
+		image[k] = value < 0 ? 0 : (value > 255 ? 255 : value);
+	}
+}
+
+static void add_sensor_noise(int seed)
+{
+	add_frame_noise(image2, seed);
+}
+
+/* every shift within range has to be recovered exactly */
+static int test_shifts(int range, bool rotation)
+{
+	int failures = 0;
+
+	for (int dy = -range; dy <= range; dy++) {
+		for (int dx = -range; dx <= range; dx++) {
+
+			float flow_x, flow_y;
+			float x_rate = 0.0f;
+			float y_rate = 0.0f;
+
+			/* gyro rates which explain the whole shift */
+			if (rotation) {
+				const float focal_length_px = global_data.param[PARAM_FOCAL_LENGTH_MM] / (4.0f * 6.0f) * 1000.0f;
+				const float dt = get_time_between_images() / 1000000.0f;
+				x_rate = dy / (dt * focal_length_px);
+				y_rate = -dx / (dt * focal_length_px);
+			}
+
+			make_images(dx, dy);
+			uint8_t qual = compute_flow(image1, image2, x_rate, y_rate, 0.0f, &flow_x, &flow_y);
+
+			if (qual == 0 || !FLOAT_EQ_INT(flow_x, dx) || !FLOAT_EQ_INT(flow_y, dy)) {
+				printf("FAIL shift (%d, %d): flow (%f, %f) qual %u\n", dx, dy, (double)flow_x, (double)flow_y, qual);
+				failures++;
+			}
+		}
+	}
+
+	return failures;
+}
+
+/* early termination must not change the result, also for imperfect matches */
+static int test_early_termination(void)
+{
+	int failures = 0;
+
+	for (int dy = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy++) {
+		for (int dx = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx++) {
+
+			float flow_x[2], flow_y[2];
+			uint8_t qual[2];
+			make_images(dx, dy);
+			add_sensor_noise(dx * 16 + dy);
+
+			for (int early = 0; early < 2; early++) {
+				global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = early;
+				qual[early] = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x[early], &flow_y[early]);
+			}
+
+			if (qual[0] != qual[1] || !FLOAT_EQ_FLOAT(flow_x[0], flow_x[1]) || !FLOAT_EQ_FLOAT(flow_y[0], flow_y[1])) {
+				printf("FAIL early termination (%d, %d): flow (%f, %f) instead of (%f, %f)\n", dx, dy,
+						(double)flow_x[1], (double)flow_y[1], (double)flow_x[0], (double)flow_y[0]);
+				failures++;
+			}
+		}
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* census matching has to find the shift across an exposure change */
+static int test_census(void)
+{
+	int failures = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_CENSUS;
+
+	for (int dy = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy++) {
+		for (int dx = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx++) {
+
+			float flow_x, flow_y;
+			make_images(dx, dy);
+
+			/* darker and lower contrast */
+			for (int k = 0; k < IMG_WIDTH * IMG_HEIGHT; k++) {
+				image2[k] = image2[k] / 2 + 20;
+			}
+
+			uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+			if (qual == 0 || fabsf(flow_x - dx) > 0.25f || fabsf(flow_y - dy) > 0.25f) {
+				printf("FAIL census (%d, %d): flow (%f, %f) qual %u\n", dx, dy, (double)flow_x, (double)flow_y, qual);
+				failures++;
+			}
+		}
+	}
+
+	/* the census of image2 is reused in the next call */
+	float flow_x[2], flow_y[2];
+	make_frame(image1, 0, 0);
+	make_frame(image2, 1, 2);
+	make_frame(image3, 3, 1);
+
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x[0], &flow_y[0]);
+	compute_flow(image2, image3, 0.0f, 0.0f, 0.0f, &flow_x[0], &flow_y[0]);
+	flow_invalidate_image(image2);
+	compute_flow(image2, image3, 0.0f, 0.0f, 0.0f, &flow_x[1], &flow_y[1]);
+
+	if (!FLOAT_EQ_FLOAT(flow_x[0], flow_x[1]) || !FLOAT_EQ_FLOAT(flow_y[0], flow_y[1]) || fabsf(flow_x[0] - 2.0f) > 0.25f) {
+		printf("FAIL census reuse: flow (%f, %f) instead of (%f, %f)\n",
+				(double)flow_x[0], (double)flow_y[0], (double)flow_x[1], (double)flow_y[1]);
+		failures++;
+	}
+
+	/* the SAD buffers share the memory of the census planes */
+	float sad_flow_x, sad_flow_y;
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x[0], &flow_y[0]);
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_SAD;
+	global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 1;
+	global_data.param[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE] = 1;
+	compute_flow(image3, image1, 0.0f, 0.0f, 0.0f, &sad_flow_x, &sad_flow_y);
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_CENSUS;
+	compute_flow(image2, image3, 0.0f, 0.0f, 0.0f, &flow_x[0], &flow_y[0]);
+
+	if (!FLOAT_EQ_FLOAT(flow_x[0], flow_x[1]) || !FLOAT_EQ_FLOAT(flow_y[0], flow_y[1])) {
+		printf("FAIL census after SAD: flow (%f, %f) instead of (%f, %f)\n",
+				(double)flow_x[0], (double)flow_y[0], (double)flow_x[1], (double)flow_y[1]);
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* zero mean SAD has to find the shift across a brightness change */
+static int test_zsad(void)
+{
+	int failures = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_ZSAD;
+
+	for (int dy = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy++) {
+		for (int dx = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx++) {
+
+			float flow_x, flow_y;
+			make_images(dx, dy);
+
+			/* brighter with a little less contrast */
+			for (int k = 0; k < IMG_WIDTH * IMG_HEIGHT; k++) {
+				image2[k] = image2[k] * 7 / 8 + 48;
+			}
+
+			uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+			if (qual == 0 || fabsf(flow_x - dx) > 0.25f || fabsf(flow_y - dy) > 0.25f) {
+				printf("FAIL zsad (%d, %d): flow (%f, %f) qual %u\n", dx, dy, (double)flow_x, (double)flow_y, qual);
+				failures++;
+			}
+		}
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* the interpolated planes have to give the same subpixel directions as compute_subpixel */
+static int test_subpixel_cache(void)
+{
+	int failures = 0;
+
+	for (int dy = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dy++) {
+		for (int dx = -BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx <= BOTTOM_FLOW_SEARCH_WINDOW_SIZE; dx++) {
+
+			float flow_x[2], flow_y[2];
+			uint8_t qual[2];
+
+			/* half pixel shift in x, the subpixel search has to find it */
+			make_images(dx, dy);
+			for (int y = 0; y < IMG_HEIGHT; y++) {
+				for (int x = 0; x < IMG_WIDTH; x++) {
+					image2[y * IMG_WIDTH + x] = (texture(x - dx, y - dy) + texture(x - dx - 1, y - dy)) / 2;
+				}
+			}
+			add_sensor_noise(dx * 16 + dy);
+
+			for (int cache = 0; cache < 2; cache++) {
+				global_data.param[PARAM_BOTTOM_FLOW_SUBPIXEL_CACHE] = cache;
+				qual[cache] = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x[cache], &flow_y[cache]);
+			}
+
+			if (qual[0] != qual[1] || !FLOAT_EQ_FLOAT(flow_x[0], flow_x[1]) || !FLOAT_EQ_FLOAT(flow_y[0], flow_y[1])) {
+				printf("FAIL subpixel cache (%d, %d): flow (%f, %f) instead of (%f, %f)\n", dx, dy,
+						(double)flow_x[1], (double)flow_y[1], (double)flow_x[0], (double)flow_y[0]);
+				failures++;
+			}
+		}
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* the parabola fit has to resolve quarter pixel shifts, which half pixel steps can not */
+static int test_parabolic(void)
+{
+	/* shifts in quarter pixels */
+	const int shifts[] = { -11, -5, -1, 1, 3, 7, 13 };
+	int failures = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 1;
+
+	for (int axis = 0; axis < 2; axis++) {
+		for (unsigned k = 0; k < sizeof(shifts) / sizeof(shifts[0]); k++) {
+
+			int pixels = (shifts[k] + 16) / 4 - 4;
+			int quarters = shifts[k] - 4 * pixels;
+			float flow[2];
+
+			/* linear interpolation between two integer shifts */
+			make_frame(image1, 0, 0);
+			make_frame(image2, axis ? 0 : pixels, axis ? pixels : 0);
+			make_frame(image3, axis ? 0 : pixels + 1, axis ? pixels + 1 : 0);
+
+			for (int p = 0; p < IMG_WIDTH * IMG_HEIGHT; p++) {
+				image2[p] = ((4 - quarters) * image2[p] + quarters * image3[p] + 2) / 4;
+			}
+
+			uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow[0], &flow[1]);
+
+			if (qual == 0 || fabsf(flow[axis] - shifts[k] / 4.0f) > 0.2f || fabsf(flow[1 - axis]) > 0.2f) {
+				printf("FAIL parabola %d/4 pixels on axis %d: flow (%f, %f) qual %u\n", shifts[k], axis,
+						(double)flow[0], (double)flow[1], qual);
+				failures++;
+			}
+		}
+	}
+
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 0;
+
+	return failures;
+}
+
+/* the scene moved by (tx, ty), rotated by angle and scaled around the image center */
+static void make_frame_similarity(uint8_t *image, float tx, float ty, float angle, float scale)
+{
+	const float c = cosf(angle) / scale;
+	const float s = sinf(angle) / scale;
+
+	for (int y = 0; y < IMG_HEIGHT; y++) {
+		for (int x = 0; x < IMG_WIDTH; x++) {
+			/* position of the pixel in the first frame, nearest neighbour */
+			float qx = x - IMG_WIDTH / 2.0f - tx;
+			float qy = y - IMG_HEIGHT / 2.0f - ty;
+			int sx = lroundf(c * qx + s * qy + IMG_WIDTH / 2.0f);
+			int sy = lroundf(-s * qx + c * qy + IMG_HEIGHT / 2.0f);
+			image[y * IMG_WIDTH + x] = texture(sx, sy);
+		}
+	}
+}
+
+/* the motion model has to separate translation, rotation and scale */
+static int test_flow_model(void)
+{
+	/* translation x, y, rotation, scale */
+	const float motions[][4] = {
+		{ 3.0f, -2.0f, 0.0f, 1.0f },
+		{ 1.0f, 1.0f, 0.03f, 1.0f },
+		{ -1.0f, 0.0f, -0.03f, 1.0f },
+		{ 0.0f, 2.0f, 0.0f, 1.04f },
+		{ 0.0f, 0.0f, 0.0f, 0.96f },
+	};
+	int failures = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_MODEL] = 1;
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 1;
+
+	for (unsigned k = 0; k < sizeof(motions) / sizeof(motions[0]); k++) {
+
+		const float *m = motions[k];
+		float flow_x, flow_y;
+
+		make_frame(image1, 0, 0);
+		make_frame_similarity(image2, m[0], m[1], m[2], m[3]);
+
+		uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+		const flow_model_t *model = get_flow_model();
+
+		if (qual == 0 || fabsf(flow_x - m[0]) > 0.3f || fabsf(flow_y - m[1]) > 0.3f ||
+				fabsf(model->rotation - m[2]) > 0.01f || fabsf(model->divergence - (m[3] - 1.0f)) > 0.01f) {
+			printf("FAIL flow model %u: flow (%f, %f) rotation %f divergence %f qual %u\n", k,
+					(double)flow_x, (double)flow_y, (double)model->rotation, (double)model->divergence, qual);
+			failures++;
+		}
+	}
+
+	/* a quarter of the tiles sees an object moving on its own */
+	float flow_x, flow_y;
+	make_frame(image1, 0, 0);
+	make_frame(image2, 1, 0);
+	for (int y = 0; y < IMG_HEIGHT / 2; y++) {
+		for (int x = 0; x < IMG_WIDTH / 2; x++) {
+			image2[y * IMG_WIDTH + x] = texture(x - 1, y - 4);
+		}
+	}
+
+	uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual == 0 || fabsf(flow_x - 1.0f) > 0.1f || fabsf(flow_y) > 0.1f) {
+		printf("FAIL flow model outliers: flow (%f, %f) qual %u\n", (double)flow_x, (double)flow_y, qual);
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* every tile reports its match, flat tiles are not searched */
+static int test_flow_field(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+	uint16_t count;
+
+	make_images(2, -1);
+	for (int y = 0; y < IMG_HEIGHT; y++) {
+		for (int x = 0; x < IMG_WIDTH / 4; x++) {
+			image1[y * IMG_WIDTH + x] = 128;
+			image2[y * IMG_WIDTH + x] = 128;
+		}
+	}
+
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+	const flow_tile_t *tiles = get_flow_field(&count);
+
+	uint16_t accepted = 0;
+	uint16_t skipped = 0;
+
+	for (uint16_t t = 0; t < count; t++) {
+		const flow_tile_t *tile = &tiles[t];
+
+		if (tile->sad == FLOW_TILE_NO_SAD) {
+			if (tile->x >= IMG_WIDTH / 4 || tile->sad2 != FLOW_TILE_NO_SAD) {
+				printf("FAIL flow field: textured tile %u at %u skipped\n", t, tile->x);
+				failures++;
+			}
+			skipped++;
+		} else if (tile->sad & FLOW_TILE_ACCEPTED) {
+			if (abs(tile->flow_x - 16) > 4 || abs(tile->flow_y + 8) > 4 ||
+					tile->sad2 < (tile->sad & ~FLOW_TILE_ACCEPTED) || tile->score == 0) {
+				printf("FAIL flow field: tile %u flow (%d, %d) sad %u sad2 %u score %u\n", t,
+						tile->flow_x, tile->flow_y, tile->sad, tile->sad2, tile->score);
+				failures++;
+			}
+			accepted++;
+		}
+	}
+
+	if (count != 25 || accepted < 15 || skipped == 0) {
+		printf("FAIL flow field: %u tiles, %u accepted, %u skipped\n", count, accepted, skipped);
+		failures++;
+	}
+
+	return failures;
+}
+
+/* a compute budget drops tiles and shrinks the search, but still finds the flow */
+static int test_budget(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+
+	make_images(1, -2);
+
+	/* half of the 2.5 ms frame interval, a tile costs 15000 of the 210000 cycles (two counter reads apart from its wait) */
+	global_data.param[PARAM_BOTTOM_FLOW_BUDGET] = 0.5f;
+	host_cycle_step = 7500;
+
+	uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual == 0 || get_flow_budget_dropped() == 0 || fabsf(flow_x - 1.0f) > 0.25f || fabsf(flow_y + 2.0f) > 0.25f) {
+		printf("FAIL budget: flow (%f, %f) qual %u dropped %u\n", (double)flow_x, (double)flow_y, qual, get_flow_budget_dropped());
+		failures++;
+	}
+
+	/* waiting for a pipelined frame is not tile cost, the waits alone exceed the budget here */
+	host_cycle_step = 1000;
+	host_wait_cycles = 20000;
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (get_flow_budget_dropped() != 0) {
+		printf("FAIL budget with waits: dropped %u\n", get_flow_budget_dropped());
+		failures++;
+	}
+
+	/* without a budget all tiles are matched */
+	global_data.param[PARAM_BOTTOM_FLOW_BUDGET] = 0;
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (get_flow_budget_dropped() != 0) {
+		printf("FAIL budget off: dropped %u\n", get_flow_budget_dropped());
+		failures++;
+	}
+
+	host_cycle_step = 0;
+	host_wait_cycles = 0;
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* over a texture repeating every 4 pixels the tiles match at two places and are rejected */
+static int test_ambiguity(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+
+	global_data.param[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD] = 0.9f;
+
+	for (int y = 0; y < IMG_HEIGHT; y++) {
+		for (int x = 0; x < IMG_WIDTH; x++) {
+			image1[y * IMG_WIDTH + x] = texture(x % 4, y);
+			image2[y * IMG_WIDTH + x] = texture((x + 3) % 4, y);
+		}
+	}
+
+	uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	uint16_t count, accepted = 0;
+	const flow_tile_t *field = get_flow_field(&count);
+
+	for (uint16_t t = 0; t < count; t++) {
+		if (field[t].sad & FLOW_TILE_ACCEPTED) {
+			accepted++;
+		}
+	}
+
+	if (qual != 0 || accepted != 0) {
+		printf("FAIL ambiguity repetitive: flow (%f, %f) qual %u accepted %u\n", (double)flow_x, (double)flow_y, qual, accepted);
+		failures++;
+	}
+
+	global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = 1;
+	qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual != 0) {
+		printf("FAIL ambiguity repetitive early termination: flow (%f, %f) qual %u\n", (double)flow_x, (double)flow_y, qual);
+		failures++;
+	}
+
+	/* without the test the aliases are accepted */
+	global_data.param[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD] = 0;
+	qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual == 0) {
+		printf("FAIL ambiguity off: qual %u\n", qual);
+		failures++;
+	}
+
+	/* a texture without repetitions keeps the full quality */
+	global_data.param[PARAM_BOTTOM_FLOW_AMBIGUITY_THRESHOLD] = 0.9f;
+	make_images(1, 2);
+	add_sensor_noise(7);
+	qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual < 200 || fabsf(flow_x - 1.0f) > 0.25f || fabsf(flow_y - 2.0f) > 0.25f) {
+		printf("FAIL ambiguity distinct: flow (%f, %f) qual %u\n", (double)flow_x, (double)flow_y, qual);
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* the tiles only wait for the rows they search, passes over all of image2 for the whole image */
+static int test_pipeline(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+	const uint32_t image_size = IMG_WIDTH * IMG_HEIGHT;
+
+	make_images(-1, 3);
+
+	host_wait_count = 0;
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (host_wait_first == 0 || host_wait_first > image_size / 2 || host_wait_last != image_size) {
+		printf("FAIL pipeline: first wait %u last %u of %u\n", host_wait_first, host_wait_last, image_size);
+		failures++;
+	}
+
+	/* census planes are computed from the whole image before the first tile */
+	global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_CENSUS;
+	host_wait_count = 0;
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (host_wait_first != image_size || host_wait_last != image_size) {
+		printf("FAIL pipeline census: first wait %u last %u of %u\n", host_wait_first, host_wait_last, image_size);
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* frames below the gradient threshold are not matched at all */
+static int test_gradient_threshold(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+	uint16_t count;
+
+	make_images(2, 1);
+	global_data.param[PARAM_BOTTOM_FLOW_GRADIENT_THRESHOLD] = 4.0f;
+
+	host_image_gradient = 1.0f;
+	uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+	get_flow_field(&count);
+
+	if (qual != 0 || count != 0 || fabsf(flow_x) > 0.0f || fabsf(flow_y) > 0.0f) {
+		printf("FAIL gradient flat: flow (%f, %f) qual %u tiles %u\n", (double)flow_x, (double)flow_y, qual, count);
+		failures++;
+	}
+
+	host_image_gradient = 20.0f;
+	qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (qual == 0 || fabsf(flow_x - 2.0f) > 0.25f || fabsf(flow_y - 1.0f) > 0.25f) {
+		printf("FAIL gradient textured: flow (%f, %f) qual %u\n", (double)flow_x, (double)flow_y, qual);
+		failures++;
+	}
+
+	host_image_gradient = 0.0f;
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* other sensor positions always fit the motion model for the time to contact */
+static int test_sensor_position(void)
+{
+	int failures = 0;
+	float flow_x, flow_y;
+
+	make_frame(image1, 0, 0);
+	make_frame_similarity(image2, 0.0f, 0.0f, 0.0f, 1.04f);
+
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 1;
+	global_data.param[PARAM_SENSOR_POSITION] = FRONT;
+	set_sensor_position_settings(FRONT);
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (get_flow_model()->inliers == 0 || fabsf(get_flow_model()->divergence - 0.04f) > 0.01f) {
+		printf("FAIL sensor position front: divergence %f inliers %u\n",
+				(double)get_flow_model()->divergence, get_flow_model()->inliers);
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+	global_data.param[PARAM_BOTTOM_FLOW_PARABOLIC] = 1;
+	global_data.param[PARAM_SENSOR_POSITION] = BOTTOM;
+	set_sensor_position_settings(BOTTOM);
+	compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+	if (get_flow_model()->inliers != 0) {
+		printf("FAIL sensor position bottom: model fitted without BFLOW_MODEL\n");
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* texture only in a narrow band between the rows of the fixed tile grid */
+static int test_tile_selection(void)
+{
+	int failures = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_TILE_SELECTION] = 1;
+
+	for (int dy = -2; dy <= 2; dy++) {
+		for (int dx = -2; dx <= 2; dx++) {
+
+			float flow_x, flow_y;
+			make_images(dx, dy);
+
+			for (int y = 0; y < IMG_HEIGHT; y++) {
+				for (int x = 0; x < IMG_WIDTH; x++) {
+					if (y < 20 || y >= 34) {
+						image1[y * IMG_WIDTH + x] = 128;
+					}
+					if (y - dy < 20 || y - dy >= 34) {
+						image2[y * IMG_WIDTH + x] = 128;
+					}
+				}
+			}
+
+			uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+			if (qual == 0 || !FLOAT_EQ_INT(flow_x, dx) || !FLOAT_EQ_INT(flow_y, dy)) {
+				printf("FAIL tile selection (%d, %d): flow (%f, %f) qual %u\n", dx, dy, (double)flow_x, (double)flow_y, qual);
+				failures++;
+			}
+		}
+	}
+
+	global_data.param[PARAM_BOTTOM_FLOW_TILE_SELECTION] = 0;
+
+	return failures;
+}
+
+/* radii with search kernels (2, 4) and without (3), full and spiral search, recover all shifts within them */
+static int test_search_radii(void)
+{
+	const int radii[] = { 2, 3, 4 };
+	int failures = 0;
+
+	for (unsigned k = 0; k < sizeof(radii) / sizeof(radii[0]); k++) {
+		global_data.param[PARAM_MAX_FLOW_PIXEL] = radii[k];
+
+		for (int early = 0; early < 2; early++) {
+			global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = early;
+
+			failures += test_shifts(radii[k], false);
+
+			/* census and ZSAD are fitted with a parabola, so only close to the shift */
+			for (int matcher = MATCHER_CENSUS; matcher <= MATCHER_ZSAD; matcher++) {
+				global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = matcher;
+
+				for (int d = -radii[k]; d <= radii[k]; d++) {
+					float flow_x, flow_y;
+					make_images(d, -d);
+					uint8_t qual = compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y);
+
+					if (qual == 0 || fabsf(flow_x - d) > 0.1f || fabsf(flow_y + d) > 0.1f) {
+						printf("FAIL radius %d early %d matcher %d shift %d: flow (%f, %f) qual %u\n",
+								radii[k], early, matcher, d, (double)flow_x, (double)flow_y, qual);
+						failures++;
+					}
+				}
+			}
+
+			global_data.param[PARAM_BOTTOM_FLOW_MATCHER] = MATCHER_SAD;
+		}
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+/* the specialized (96, 128) and generic (80) SAD kernels have to match the 64 pixel one */
+static int test_image_sizes(void)
+{
+	const int sizes[] = { 80, 96, 128 };
+	int failures = 0;
+
+	for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+		global_data.param[PARAM_IMAGE_WIDTH] = sizes[k];
+		global_data.param[PARAM_IMAGE_HEIGHT] = sizes[k];
+
+		for (int early = 0; early < 2; early++) {
+			global_data.param[PARAM_BOTTOM_FLOW_EARLY_TERMINATION] = early;
+			failures += test_shifts(BOTTOM_FLOW_SEARCH_WINDOW_SIZE, false);
+		}
+
+		global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 1;
+		failures += test_shifts(2 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE, false);
+		global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 0;
+	}
+
+	/* larger than the flow buffers */
+	float flow_x, flow_y;
+	global_data.param[PARAM_IMAGE_WIDTH] = 144;
+	if (compute_flow(image1, image2, 0.0f, 0.0f, 0.0f, &flow_x, &flow_y) != 0) {
+		printf("FAIL image size 144 accepted\n");
+		failures++;
+	}
+
+	global_data_reset_param_defaults();
+
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+
+	int failures = 0;
+
+	global_data_reset_param_defaults();
+
+	failures += test_shifts(BOTTOM_FLOW_SEARCH_WINDOW_SIZE, false);
+
+	global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 1;
+	failures += test_shifts(2 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE, false);
+	global_data.param[PARAM_BOTTOM_FLOW_PYRAMID] = 0;
+
+	global_data.param[PARAM_BOTTOM_FLOW_GYRO_PREDICTION] = 1;
+	failures += test_shifts(2 * BOTTOM_FLOW_SEARCH_WINDOW_SIZE, true);
+	global_data.param[PARAM_BOTTOM_FLOW_GYRO_PREDICTION] = 0;
+
+	failures += test_early_termination();
+	failures += test_tile_selection();
+	failures += test_subpixel_cache();
+	failures += test_parabolic();
+	failures += test_flow_model();
+	failures += test_sensor_position();
+	failures += test_flow_field();
+	failures += test_budget();
+	failures += test_gradient_threshold();
+	failures += test_pipeline();
+	failures += test_ambiguity();
+	failures += test_census();
+	failures += test_zsad();
+	failures += test_search_radii();
+	failures += test_image_sizes();
+
+	printf("flow: %d failures\n", failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
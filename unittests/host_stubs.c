@@ -0,0 +1,58 @@
+/**
+ * Host replacements for the board functions the flow engine links against
+ */
+
+#include <stdint.h>
+#include "mavlink_bridge_header.h"
+#include <mavlink.h>
+#include "dcmi.h"
+#include "debug.h"
+#include "main.h"
+
+/* core clock of the STM32F4 */
+uint32_t SystemCoreClock = 168000000;
+
+/* 400 Hz frame interval */
+uint32_t get_time_between_images(void)
+{
+	return 2500;
+}
+
+/* mean gradient of the last copied frame, set by the tests */
+float host_image_gradient = 0.0f;
+
+float get_image_gradient(void)
+{
+	return host_image_gradient;
+}
+
+/* fake cycle counter, advanced by host_cycle_step on every read */
+uint32_t host_cycle_step = 0;
+static uint32_t host_cycle_count = 0;
+
+uint32_t get_cycle_count(void)
+{
+	host_cycle_count += host_cycle_step;
+	return host_cycle_count;
+}
+
+/* sizes compute_flow waited for, the images of the tests are always complete */
+uint32_t host_wait_first = 0;
+uint32_t host_wait_count = 0;
+uint32_t host_wait_last = 0;
+uint32_t host_wait_cycles = 0; // cycle counter advance of every wait, like a frame still arriving
+
+void dcmi_wait_image(const uint8_t *image, uint32_t size)
+{
+	if (host_wait_count++ == 0) {
+		host_wait_first = size;
+	}
+
+	host_wait_last = size;
+	host_cycle_count += host_wait_cycles;
+}
+
+uint8_t debug_int_message_buffer(const char* string, int32_t num)
+{
+	return 0;
+}